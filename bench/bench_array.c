@@ -0,0 +1,70 @@
+//array随机访问的基准：类似text3的数字矩阵放大，按下标取元素
+//比较沿着child/next走到第i个和cjson_array_get，以及从后往前遍历
+//gcc -O2 -I.. -o bench_array bench_array.c ../cjson.c -lm -pthread
+//./bench_array [行数] [列数]，默认2000行，2000列
+#include "../cjson.h"
+#include <time.h>
+
+static double now(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+//手写的按下标取：沿着链表走
+static const Cjson* walk_to(const Cjson* arr, size_t i) {
+  const Cjson* cur = arr->child;
+  for(; cur && i; cur = cur->next, i--)
+    ;
+  return cur;
+}
+
+int main(int argc, char** argv) {
+  int rows = argc > 1 ? atoi(argv[1]) : 2000, cols = argc > 2 ? atoi(argv[2]) : 2000;
+  char* doc = (char*)malloc((size_t)rows * cols * 8 + rows * 4 + 16);
+  size_t len = sprintf(doc, "[");
+  for(int r = 0; r < rows; r++) {
+    len += sprintf(doc + len, "%s[", r ? "," : "");
+    for(int c = 0; c < cols; c++) {
+      len += sprintf(doc + len, "%s%d", c ? "," : "", (r * 31 + c * 17) % 10000);
+    }
+    len += sprintf(doc + len, "]");
+  }
+  sprintf(doc + len, "]");
+  Cjson* root = cjson_parse(doc);
+  size_t samples = 1000000;
+  uint32_t seed = 1;
+  int64_t sum = 0;
+  printf("%d x %d matrix, %.1f MB\n", rows, cols, len / 1e6);
+
+  double start = now();
+  for(size_t k = 0; k < samples / 100; k++) { //走链表太慢，只取百分之一
+    seed = seed * 1103515245u + 12345u;
+    size_t r = (seed >> 8) % rows, c = (seed >> 4) % cols;
+    sum += walk_to(walk_to(root, r), c)->value.intNum;
+  }
+  printf("%-22s %8.2f ms (x100) %lld\n", "child/next walk", (now() - start) * 1e5, (long long)sum);
+
+  sum = 0;
+  seed = 1;
+  start = now();
+  for(size_t k = 0; k < samples; k++) {
+    seed = seed * 1103515245u + 12345u;
+    size_t r = (seed >> 8) % rows, c = (seed >> 4) % cols;
+    sum += cjson_array_get(cjson_array_get(root, r), c)->value.intNum;
+  }
+  printf("%-22s %8.2f ms %lld\n", "cjson_array_get", (now() - start) * 1e3, (long long)sum);
+
+  sum = 0;
+  start = now();
+  for(size_t r = cjson_array_size(root); r-- > 0;) {
+    const Cjson* row = cjson_array_get(root, r);
+    for(size_t c = cjson_array_size(row); c-- > 0;) {
+      sum += cjson_array_get(row, c)->value.intNum;
+    }
+  }
+  printf("%-22s %8.2f ms %lld\n", "backwards by index", (now() - start) * 1e3, (long long)sum);
+  deleteCjson(root);
+  free(doc);
+  return 0;
+}
@@ -0,0 +1,70 @@
+//二进制编码的基准：test.c里的几个示例文档，比较文本和二进制两条路的保存和读入
+//保存是print_json对cjson_binary_encode，读入是cjson_parse对cjson_binary_decode，每个文档重复很多次取平均
+//gcc -O2 -I.. -o bench_binary bench_binary.c ../cjson.c -lm -pthread
+//./bench_binary [次数]，默认200000
+#include "../cjson.h"
+#include <time.h>
+
+static double now(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+int main(int argc, char** argv) {
+  static const struct {
+    const char* name;
+    const char* text;
+  } samples[] = { //和test.c里的text1到text9一样
+    {"text1", "{\n\"name\": \"Jack (\\\"Bee\\\") Nimble\", \n\"format\": {\"type\":       \"rect\", \n\"width\":      1920, \n"
+      "\"height\":     1080, \n\"interlace\":  false,\"frame rate\": 24\n},\"a\":1\n}"},
+    {"text2", "[\"Sunday\", \"Monday\", \"Tuesday\", \"Wednesday\", \"Thursday\", \"Friday\", \"Saturday\"]"},
+    {"text3", "[\n    [0, -1, 0],\n    [1, 0, 0],\n    [0, 0, 1]\n	]\n"},
+    {"text4", "{\n		\"Image\": {\n			\"Width\":  800,\n			\"Height\": 600,\n			\"Title\":  \"View from 15th Floor\",\n"
+      "			\"Thumbnail\": {\n				\"Url\":    \"http:/*www.example.com/image/481989943\",\n				\"Height\": 125,\n"
+      "				\"Width\":  \"100\"\n			},\n			\"IDs\": [116, 943, 234, 38793]\n		}\n	}"},
+    {"text5", "[\n	 {\n	 \"precision\": \"zip\",\n	 \"Latitude\":  37.7668,\n	 \"Longitude\": -122.3959,\n	 \"Address\":   \"\",\n"
+      "	 \"City\":      \"SAN FRANCISCO\",\n	 \"State\":     \"CA\",\n	 \"Zip\":       \"94107\",\n	 \"Country\":   \"US\"\n	 },\n"
+      "	 {\n	 \"precision\": \"zip\",\n	 \"Latitude\":  37.371991,\n	 \"Longitude\": -122.026020,\n	 \"Address\":   \"\",\n"
+      "	 \"City\":      \"SUNNYVALE\",\n	 \"State\":     \"CA\",\n	 \"Zip\":       \"94085\",\n	 \"Country\":   \"US\"\n	 }\n	 ]"},
+    {"text6", "\"\\\"\\u1234abc\\u1234abc\\\"123\""},
+    {"text7", "false"},
+    {"text8", "-10e-10"},
+    {"text9", "{\"name\": \"asd\"}"},
+  };
+  int rounds = argc > 1 ? atoi(argv[1]) : 200000;
+  printf("%-6s %6s %6s %6s | %9s %9s | %9s %9s  ns/op\n", "doc", "text", "min", "binary",
+    "print", "encode", "parse", "decode");
+  for(size_t s = 0; s < sizeof(samples) / sizeof(samples[0]); s++) {
+    Cjson* root = cjson_parse(samples[s].text);
+    const char* text = print_json(root);
+    size_t binLen = 0;
+    void* bin = cjson_binary_encode(root, &binLen);
+    double start = now();
+    for(int i = 0; i < rounds; i++) {
+      free((void*)print_json(root));
+    }
+    double print = (now() - start) / rounds * 1e9;
+    start = now();
+    for(int i = 0; i < rounds; i++) {
+      cjson_binary_free(cjson_binary_encode(root, NULL));
+    }
+    double encode = (now() - start) / rounds * 1e9;
+    start = now();
+    for(int i = 0; i < rounds; i++) {
+      deleteCjson(cjson_parse(text));
+    }
+    double parse = (now() - start) / rounds * 1e9;
+    start = now();
+    for(int i = 0; i < rounds; i++) {
+      deleteCjson(cjson_binary_decode(bin, binLen));
+    }
+    double decode = (now() - start) / rounds * 1e9;
+    printf("%-6s %6zu %6zu %6zu | %9.1f %9.1f | %9.1f %9.1f\n", samples[s].name, strlen(samples[s].text), strlen(text), binLen,
+      print, encode, parse, decode);
+    cjson_binary_free(bin);
+    free((void*)text);
+    deleteCjson(root);
+  }
+  return 0;
+}
@@ -0,0 +1,56 @@
+//object成员查找的基准：不同宽度的object上比较cjson_get和手写的child/next+strcmp遍历
+//gcc -O2 -I.. -o bench_get bench_get.c ../cjson.c
+#include "../cjson.h"
+#include <time.h>
+
+static double now(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+//逐个比较键名，相当于以前调用方自己写的循环
+static Cjson* linear_get(const Cjson* obj, const char* key) {
+  for(Cjson* cur = obj->child; cur; cur = cur->next) {
+    if(strcmp(cur->keyName, key) == 0)
+      return cur;
+  }
+  return NULL;
+}
+
+int main(void) {
+  static const int widths[] = {4, 8, 16, 32, 64, 128, 256, 512, 1024, 4096};
+  printf("%8s %14s %14s\n", "width", "linear ns/op", "cjson_get ns/op");
+  for(size_t w = 0; w < sizeof(widths) / sizeof(widths[0]); w++) {
+    int width = widths[w], lookups = 2000000;
+    char* doc = (char*)malloc(width * 40 + 16);
+    char (*keys)[32] = (char (*)[32])malloc(width * 32);
+    int len = sprintf(doc, "{");
+    for(int i = 0; i < width; i++) {
+      sprintf(keys[i], "field_%d_name", i);
+      len += sprintf(doc + len, "%s\"%s\":%d", i ? "," : "", keys[i], i);
+    }
+    sprintf(doc + len, "}");
+    Cjson* obj = cjson_parse(doc);
+    long sum = 0;
+    unsigned seed = 1;
+    double start = now();
+    for(int i = 0; i < lookups; i++) {
+      seed = seed * 1103515245 + 12345;
+      sum += linear_get(obj, keys[(seed >> 8) % width])->value.intNum;
+    }
+    double linear = (now() - start) / lookups * 1e9;
+    seed = 1;
+    start = now();
+    for(int i = 0; i < lookups; i++) {
+      seed = seed * 1103515245 + 12345;
+      sum -= cjson_get(obj, keys[(seed >> 8) % width])->value.intNum;
+    }
+    double hashed = (now() - start) / lookups * 1e9;
+    printf("%8d %14.1f %14.1f%s\n", width, linear, hashed, sum ? " (mismatch)" : "");
+    deleteCjson(obj);
+    free(keys);
+    free(doc);
+  }
+  return 0;
+}
@@ -0,0 +1,58 @@
+//多线程解析的基准：很大的顶层array和ndjson，比较cjson_parse和1/2/4/8个线程的cjson_parse_parallel，cjson_parse_ndjson
+//gcc -O2 -pthread -I.. -o bench_parallel bench_parallel.c ../cjson.c -lm
+//./bench_parallel [记录数]，默认1000000
+#include "../cjson.h"
+#include <time.h>
+
+static double now(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+//生成类似text5的记录，sep是记录之间的分隔
+static char* make_records(int count, const char* head, const char* sep, const char* tail, size_t* outLen) {
+  char* doc = (char*)malloc((size_t)count * 160 + 16);
+  size_t len = sprintf(doc, "%s", head);
+  for(int i = 0; i < count; i++) {
+    len += sprintf(doc + len, "%s{\"id\":%d,\"name\":\"user \\\"%d\\\"\",\"score\":%d.25,"
+      "\"tags\":[\"a\",\"b\"],\"active\":%s,\"note\":null}",
+      i ? sep : "", i, i, i % 1000, i % 2 ? "true" : "false");
+  }
+  len += sprintf(doc + len, "%s", tail);
+  *outLen = len;
+  return doc;
+}
+
+static double run(const char* doc, int threads, bool ndjson) {
+  double start = now();
+  Cjson* root = threads == 0 ? cjson_parse(doc) :
+    ndjson ? cjson_parse_ndjson(doc, threads) : cjson_parse_parallel(doc, threads);
+  double used = now() - start;
+  deleteCjson(root);
+  return used;
+}
+
+int main(int argc, char** argv) {
+  static const int threads[] = {1, 2, 4, 8};
+  int count = argc > 1 ? atoi(argv[1]) : 1000000;
+  size_t len;
+  for(int ndjson = 0; ndjson < 2; ndjson++) {
+    char* doc = ndjson ? make_records(count, "", "\n", "\n", &len) : make_records(count, "[", ",", "]", &len);
+    printf("%s, %d records, %.1f MB\n", ndjson ? "ndjson" : "top-level array", count, len / 1e6);
+    if(!ndjson) {
+      double base = run(doc, 0, false);
+      printf("%12s %10.1f ms %8.1f MB/s\n", "cjson_parse", base * 1e3, len / base / 1e6);
+    }
+    double single = 0;
+    for(size_t t = 0; t < sizeof(threads) / sizeof(threads[0]); t++) {
+      double used = run(doc, threads[t], ndjson);
+      if(t == 0) {
+        single = used;
+      }
+      printf("%9d thr %10.1f ms %8.1f MB/s %6.2fx\n", threads[t], used * 1e3, len / used / 1e6, single / used);
+    }
+    free(doc);
+  }
+  return 0;
+}
@@ -0,0 +1,90 @@
+//查询路径的基准：在很多条记录上反复取同一个路径的值
+//比较手写的child/next加strcmp，cjson_get一层层取，编译好的cjson_query_first，以及cjson_query_parse只解析匹配的值
+//gcc -O2 -I.. -o bench_query bench_query.c ../cjson.c -lm -pthread
+//./bench_query [记录数]，默认200000
+#include "../cjson.h"
+#include <time.h>
+
+static double now(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+//生成一个记录组成的array，每条记录有几个字段和一层嵌套的object
+static char* make_records(int count) {
+  char* doc = (char*)malloc((size_t)count * 200 + 16);
+  size_t len = sprintf(doc, "[");
+  for(int i = 0; i < count; i++) {
+    len += sprintf(doc + len, "%s{\"id\":%d,\"name\":\"user %d\",\"tags\":[\"a\",\"b\"],\"active\":%s,"
+      "\"address\":{\"street\":\"%d Main St\",\"zip\":\"%05d\",\"City\":\"city %d\"},\"score\":%d.5}",
+      i ? "," : "", i, i, i % 2 ? "true" : "false", i, i % 100000, i % 50, i % 1000);
+  }
+  sprintf(doc + len, "]");
+  return doc;
+}
+
+//手写的查找：按键名一个个比较
+static const Cjson* find_member(const Cjson* obj, const char* key) {
+  for(const Cjson* cur = obj ? obj->child : NULL; cur; cur = cur->next) {
+    if(!strcmp(cur->keyName, key)) {
+      return cur;
+    }
+  }
+  return NULL;
+}
+
+int main(int argc, char** argv) {
+  int count = argc > 1 ? atoi(argv[1]) : 200000;
+  char* doc = make_records(count);
+  Cjson* root = cjson_parse(doc);
+  CjsonQuery* record = cjson_query_compile("address.City");
+  CjsonQuery* all = cjson_query_compile("[*].address.City");
+  size_t found = 0;
+  printf("%d records, %.1f MB\n", count, strlen(doc) / 1e6);
+
+  double start = now();
+  for(const Cjson* cur = root->child; cur; cur = cur->next) {
+    found += find_member(find_member(cur, "address"), "City") != NULL;
+  }
+  printf("%-22s %8.2f ms %zu\n", "child/next + strcmp", (now() - start) * 1e3, found);
+
+  found = 0;
+  start = now();
+  for(const Cjson* cur = root->child; cur; cur = cur->next) {
+    found += cjson_get(cjson_get(cur, "address"), "City") != NULL;
+  }
+  printf("%-22s %8.2f ms %zu\n", "cjson_get", (now() - start) * 1e3, found);
+
+  found = 0;
+  start = now();
+  for(const Cjson* cur = root->child; cur; cur = cur->next) {
+    found += cjson_query_first(record, cur) != NULL;
+  }
+  printf("%-22s %8.2f ms %zu\n", "cjson_query_first", (now() - start) * 1e3, found);
+
+  start = now();
+  found = cjson_query_all(all, root, NULL, 0);
+  printf("%-22s %8.2f ms %zu\n", "cjson_query_all", (now() - start) * 1e3, found);
+  deleteCjson(root);
+
+  start = now();
+  root = cjson_parse(doc);
+  found = cjson_query_all(all, root, NULL, 0);
+  deleteCjson(root);
+  printf("%-22s %8.2f ms %zu\n", "parse + query", (now() - start) * 1e3, found);
+
+  start = now();
+  root = cjson_query_parse(all, doc);
+  found = 0;
+  for(const Cjson* cur = root->child; cur; cur = cur->next) {
+    found++;
+  }
+  deleteCjson(root);
+  printf("%-22s %8.2f ms %zu\n", "cjson_query_parse", (now() - start) * 1e3, found);
+
+  cjson_query_free(record);
+  cjson_query_free(all);
+  free(doc);
+  return 0;
+}
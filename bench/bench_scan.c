@@ -0,0 +1,58 @@
+//字符串和空白扫描的微基准：同一份文档分别用逐字节，sse2，avx2解析
+//gcc -O2 -I.. -o bench_scan bench_scan.c ../cjson.c
+#include "../cjson.h"
+#include <time.h>
+
+//生成缩进很深，字符串很多的文档
+static char* make_doc(size_t records, size_t* outLen) {
+  static const char* words[] = {"SAN FRANCISCO", "SUNNYVALE", "Jack (\\\"Bee\\\") Nimble",
+    "http://www.example.com/image/481989943", "View from 15th Floor"};
+  size_t cap = records * 400 + 16, len = 0;
+  char* doc = (char*)malloc(cap);
+  len += sprintf(doc + len, "[\n");
+  for(size_t i = 0; i < records; i++) {
+    len += sprintf(doc + len, "%s        {\n", i ? ",\n" : "");
+    len += sprintf(doc + len, "                \"precision\":        \"zip\",\n");
+    len += sprintf(doc + len, "                \"City\":             \"%s\",\n", words[i % 5]);
+    len += sprintf(doc + len, "                \"Description\":      \"%s %s %s\",\n",
+      words[(i + 1) % 5], words[(i + 2) % 5], words[(i + 3) % 5]);
+    len += sprintf(doc + len, "                \"Country\":          \"US\"\n");
+    len += sprintf(doc + len, "        }");
+  }
+  len += sprintf(doc + len, "\n]\n");
+  *outLen = len;
+  return doc;
+}
+
+static double now(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+int main(int argc, const char** argv) {
+  size_t records = argc > 1 ? strtoul(argv[1], NULL, 10) : 20000, len;
+  int rounds = 20;
+  char* doc = make_doc(records, &len);
+  static const char* names[] = {"auto", "scalar", "sse2", "avx2"};
+  cjson_scan_mode_t modes[] = {CJSON_SCAN_SCALAR, CJSON_SCAN_SSE2, CJSON_SCAN_AVX2};
+  for(int m = 0; m < 3; m++) {
+    cjson_set_scan_mode(modes[m]);
+    CjsonArena* warm = cjson_arena_new(0); //arena里解析，尽量只测扫描
+    cjson_parse_arena(doc, warm);
+    cjson_arena_free(warm);
+    double best = 1e30;
+    for(int r = 0; r < rounds; r++) {
+      CjsonArena* arena = cjson_arena_new(0);
+      double start = now();
+      cjson_parse_arena(doc, arena);
+      double cost = now() - start;
+      cjson_arena_free(arena);
+      if(cost < best)
+        best = cost;
+    }
+    printf("%-7s %8.1f MB/s\n", names[modes[m]], len / best / 1e6);
+  }
+  free(doc);
+  return 0;
+}
@@ -0,0 +1,208 @@
+//基准套件：在几类生成的文档上测cjson_parse，print_json，deleteCjson
+//每类文档输出一行json：解析和输出的MB/s，删除用时，每个文档的分配次数和字节数，峰值RSS
+//make bench编译并运行，结果追加到bench/results.jsonl，也可以单独编译：
+//gcc -O2 -I.. -o bench_suite bench_suite.c ../cjson.c -lm -pthread
+//./bench_suite [倍数] [版本]，倍数放大文档，默认1；版本原样写到每行的rev里
+#include "../cjson.h"
+#include <stdarg.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/resource.h>
+#include <sys/wait.h>
+
+//只增不减的输出缓冲区，生成文档用
+typedef struct {
+  char* data;
+  size_t len;
+  size_t cap;
+} text_t;
+
+static size_t alloc_count; //new_hook记下的分配次数和字节数
+static size_t alloc_bytes;
+static size_t free_count;
+
+static void* counting_malloc(size_t size) {
+  alloc_count++;
+  alloc_bytes += size;
+  return malloc(size);
+}
+
+static void counting_free(void* ptr) {
+  free_count++;
+  free(ptr);
+}
+
+static double now(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+//追加格式化的内容，不够时按两倍扩容
+static void text_printf(text_t* t, const char* fmt, ...) {
+  va_list args;
+  for(;;) {
+    va_start(args, fmt);
+    int n = vsnprintf(t->data + t->len, t->cap - t->len, fmt, args);
+    va_end(args);
+    if(n >= 0 && (size_t)n < t->cap - t->len) {
+      t->len += n;
+      return ;
+    }
+    t->cap = t->cap * 2 + n;
+    t->data = (char*)realloc(t->data, t->cap);
+  }
+}
+
+//固定种子的随机数，每次生成的文档都一样
+static uint32_t next_rand(uint32_t* seed) {
+  *seed = *seed * 1103515245u + 12345u;
+  return *seed >> 8;
+}
+
+//类似canada.json：多边形坐标，几乎全是17位有效数字的小数
+static void make_canada(text_t* t, int scale) {
+  uint32_t seed = 1;
+  text_printf(t, "{\"type\":\"FeatureCollection\",\"features\":[{\"type\":\"Feature\",\"properties\":{\"name\":\"Canada\"},"
+    "\"geometry\":{\"type\":\"Polygon\",\"coordinates\":[");
+  for(int ring = 0; ring < 40 * scale; ring++) {
+    text_printf(t, "%s[", ring ? "," : "");
+    for(int i = 0; i < 1000; i++) {
+      double x = -141.0 + next_rand(&seed) % 8000000 / 100000.0 + 0.000000000000007,
+        y = 41.0 + next_rand(&seed) % 4200000 / 100000.0 + 0.000000000000009;
+      text_printf(t, "%s[%.17g,%.17g]", i ? "," : "", x, y);
+    }
+    text_printf(t, "]");
+  }
+  text_printf(t, "]}}]}");
+}
+
+//类似twitter.json：字符串多的object，有转义和\u，用户信息嵌套一层
+static void make_twitter(text_t* t, int scale) {
+  static const char* texts[] = {"RT @jack: just setting up my twttr",
+    "\\u3042\\u3044\\u3046\\u3048\\u304a \\u65e5\\u672c\\u8a9e\\u306e\\u30c4\\u30a4\\u30fc\\u30c8",
+    "line one\\nline two\\t\\\"quoted\\\" http:\\/\\/t.co\\/abc123",
+    "caf\\u00e9 na\\u00efve r\\u00e9sum\\u00e9 \\ud83d\\ude00"};
+  uint32_t seed = 2;
+  text_printf(t, "{\"statuses\":[");
+  for(int i = 0; i < 2000 * scale; i++) {
+    uint32_t r = next_rand(&seed);
+    text_printf(t, "%s{\"created_at\":\"Sun Aug 31 00:29:%02u +0000 2014\",\"id\":%u%06u,\"id_str\":\"%u%06u\","
+      "\"text\":\"%s\",\"source\":\"<a href=\\\"http:\\/\\/twitter.com\\\" rel=\\\"nofollow\\\">Twitter Web Client<\\/a>\","
+      "\"truncated\":false,\"in_reply_to_status_id\":null,\"user\":{\"id\":%u,\"name\":\"user %u\","
+      "\"screen_name\":\"user_%u\",\"location\":\"\\u6771\\u4eac\",\"description\":\"%s\",\"followers_count\":%u,"
+      "\"verified\":%s,\"lang\":\"ja\"},\"retweet_count\":%u,\"favorited\":false,\"lang\":\"ja\","
+      "\"entities\":{\"hashtags\":[],\"urls\":[],\"user_mentions\":[{\"screen_name\":\"jack\",\"indices\":[3,8]}]}}",
+      i ? "," : "", r % 60, 5055 + i % 10, r % 1000000, 5055 + i % 10, r % 1000000, texts[r % 4],
+      r % 100000, r % 100000, r % 100000, texts[(r >> 4) % 4], r % 5000, r & 1 ? "true" : "false", r % 300);
+  }
+  text_printf(t, "],\"search_metadata\":{\"count\":%d}}", 2000 * scale);
+}
+
+//嵌套很深：很多个几百层的object和array交替嵌套
+static void make_deep(text_t* t, int scale) {
+  text_printf(t, "[");
+  for(int i = 0; i < 200 * scale; i++) {
+    text_printf(t, "%s", i ? "," : "");
+    for(int d = 0; d < 400; d++) {
+      text_printf(t, d % 2 ? "[" : "{\"k\":");
+    }
+    text_printf(t, "%d", i);
+    for(int d = 399; d >= 0; d--) {
+      text_printf(t, d % 2 ? "]" : "}");
+    }
+  }
+  text_printf(t, "]");
+}
+
+//很宽的object：一层里几万个成员
+static void make_wide(text_t* t, int scale) {
+  uint32_t seed = 3;
+  text_printf(t, "{");
+  for(int i = 0; i < 50000 * scale; i++) {
+    text_printf(t, "%s\"member_%d_%u\":%u", i ? "," : "", i, next_rand(&seed) % 1000, next_rand(&seed));
+  }
+  text_printf(t, "}");
+}
+
+//跑一类文档，结果按一行json输出；在子进程里跑，峰值RSS只算这一类
+static void run_corpus(const char* name, void (*make)(text_t*, int), int scale, const char* rev) {
+  text_t doc;
+  doc.cap = 1 << 20;
+  doc.len = 0;
+  doc.data = (char*)malloc(doc.cap);
+  make(&doc, scale);
+  Cjson* root = cjson_parse(doc.data);
+  if(!root) {
+    const CjsonError* err = cjson_last_error();
+    fprintf(stderr, "%s: %s at %zu:%zu\n", name, err->reason, err->line, err->column);
+    exit(1);
+  }
+  const char* out = print_json(root);
+  size_t outLen = strlen(out);
+  free((void*)out);
+  deleteCjson(root);
+
+  double parseBest = 1e30, printBest = 1e30, deleteBest = 1e30, started = now();
+  size_t parseAllocs = 0, parseBytes = 0, printAllocs = 0, deleteFrees = 0;
+  for(int round = 0; round < 5 || (round < 50 && now() - started < 1.0); round++) { //至少5轮，最多1秒，取最快的一轮
+    alloc_count = alloc_bytes = free_count = 0;
+    double start = now();
+    root = cjson_parse(doc.data);
+    double parseCost = now() - start;
+    parseAllocs = alloc_count;
+    parseBytes = alloc_bytes;
+    alloc_count = 0;
+    start = now();
+    out = print_json(root);
+    double printCost = now() - start;
+    printAllocs = alloc_count;
+    counting_free((void*)out);
+    free_count = 0;
+    start = now();
+    deleteCjson(root);
+    double deleteCost = now() - start;
+    deleteFrees = free_count;
+    parseBest = parseCost < parseBest ? parseCost : parseBest;
+    printBest = printCost < printBest ? printCost : printBest;
+    deleteBest = deleteCost < deleteBest ? deleteCost : deleteBest;
+  }
+  struct rusage usage;
+  getrusage(RUSAGE_SELF, &usage);
+  printf("{\"rev\":\"%s\",\"time\":%ld,\"corpus\":\"%s\",\"input_bytes\":%zu,\"output_bytes\":%zu,"
+    "\"parse_mbps\":%.1f,\"print_mbps\":%.1f,\"parse_ms\":%.3f,\"print_ms\":%.3f,\"delete_ms\":%.3f,"
+    "\"parse_allocs\":%zu,\"parse_alloc_bytes\":%zu,\"print_allocs\":%zu,\"delete_frees\":%zu,\"peak_rss_kb\":%ld}\n",
+    rev, (long)time(NULL), name, doc.len, outLen, doc.len / parseBest / 1e6, outLen / printBest / 1e6,
+    parseBest * 1e3, printBest * 1e3, deleteBest * 1e3, parseAllocs, parseBytes, printAllocs, deleteFrees,
+    (long)usage.ru_maxrss);
+  free(doc.data);
+}
+
+int main(int argc, char** argv) {
+  static const struct {
+    const char* name;
+    void (*make)(text_t*, int);
+  } corpora[] = {{"canada", make_canada}, {"twitter", make_twitter}, {"deep", make_deep}, {"wide", make_wide}};
+  int scale = argc > 1 ? atoi(argv[1]) : 1;
+  const char* rev = argc > 2 ? argv[2] : "unknown";
+  NewHook hook = {counting_malloc, counting_free};
+  new_hook(&hook);
+  if(scale < 1) {
+    scale = 1;
+  }
+  for(size_t i = 0; i < sizeof(corpora) / sizeof(corpora[0]); i++) {
+    fflush(stdout);
+    pid_t pid = fork();
+    if(pid == 0) {
+      run_corpus(corpora[i].name, corpora[i].make, scale, rev);
+      fflush(stdout);
+      _exit(0);
+    }
+    int status = 1;
+    if(pid < 0 || waitpid(pid, &status, 0) < 0 || !WIFEXITED(status) || WEXITSTATUS(status)) {
+      fprintf(stderr, "corpus %s failed\n", corpora[i].name);
+      return 1;
+    }
+  }
+  return 0;
+}
@@ -0,0 +1,90 @@
+//tape的基准：同一份文档比较遍历节点树和遍历tape，以及cjson_parse，cjson_parse+cjson_tape_freeze，cjson_tape_parse
+//文档是很多条类似text5的记录，遍历时把所有数字加起来，字符串算长度
+//gcc -O2 -I.. -o bench_tape bench_tape.c ../cjson.c -lm -pthread
+//./bench_tape [记录数]，默认200000
+#include "../cjson.h"
+#include <time.h>
+
+static double now(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+//递归遍历节点树，按child/next找下一个节点
+static double walk_tree(const Cjson* item) {
+  double sum = 0;
+  for(; item; item = item->next) {
+    if(item->nodeType == NodeType_NUMBER) {
+      sum += item->isInt ? (double)item->value.intNum : item->value.doubleNum;
+    } else if(item->nodeType == NodeType_STRING) {
+      sum += strlen(item->value.complex);
+    } else if(item->child) {
+      sum += walk_tree(item->child);
+    }
+  }
+  return sum;
+}
+
+//递归遍历tape，同样的顺序
+static double walk_tape(CjsonTapeValue v) {
+  double sum = 0;
+  for(; v.tape; v = cjson_tape_next(v)) {
+    nodetype_t type = cjson_tape_type(v);
+    if(type == NodeType_NUMBER) {
+      sum += cjson_tape_number(v);
+    } else if(type == NodeType_STRING) {
+      size_t len;
+      cjson_tape_string(v, &len);
+      sum += len;
+    } else if(type == NodeType_ARRAY || type == NodeType_OBJECT) {
+      sum += walk_tape(cjson_tape_first(v));
+    }
+  }
+  return sum;
+}
+
+int main(int argc, char** argv) {
+  int count = argc > 1 ? atoi(argv[1]) : 200000;
+  char* doc = (char*)malloc((size_t)count * 200 + 16);
+  size_t len = sprintf(doc, "[");
+  for(int i = 0; i < count; i++) {
+    len += sprintf(doc + len, "%s{\"precision\":\"zip\",\"Latitude\":%d.7668,\"Longitude\":-%d.3959,\"Address\":\"\","
+      "\"City\":\"SAN FRANCISCO\",\"State\":\"CA\",\"Zip\":\"%05d\",\"Country\":\"US\",\"tags\":[%d,%d,%d]}",
+      i ? "," : "", i % 90, i % 180, i % 100000, i, i + 1, i + 2);
+  }
+  len += sprintf(doc + len, "]");
+  printf("%d records, %.1f MB\n", count, len / 1e6);
+
+  double start = now();
+  Cjson* root = cjson_parse(doc);
+  double parse = now() - start;
+  start = now();
+  CjsonTape* frozen = cjson_tape_freeze(root);
+  double freeze = now() - start;
+  cjson_tape_free(frozen);
+  start = now();
+  CjsonTape* tape = cjson_tape_parse(doc);
+  double direct = now() - start;
+  printf("%-26s %10.1f ms\n", "cjson_parse", parse * 1e3);
+  printf("%-26s %10.1f ms\n", "cjson_parse + freeze", (parse + freeze) * 1e3);
+  printf("%-26s %10.1f ms\n", "cjson_tape_parse", direct * 1e3);
+
+  double treeBest = 1e30, tapeBest = 1e30, treeSum = 0, tapeSum = 0;
+  for(int round = 0; round < 5; round++) { //取最快的一轮
+    start = now();
+    treeSum = walk_tree(root);
+    double used = now() - start;
+    treeBest = used < treeBest ? used : treeBest;
+    start = now();
+    tapeSum = walk_tape(cjson_tape_root(tape));
+    used = now() - start;
+    tapeBest = used < tapeBest ? used : tapeBest;
+  }
+  printf("%-26s %10.1f ms\n", "walk tree", treeBest * 1e3);
+  printf("%-26s %10.1f ms%s\n", "walk tape", tapeBest * 1e3, treeSum != tapeSum ? " (mismatch)" : "");
+  cjson_tape_free(tape);
+  deleteCjson(root);
+  free(doc);
+  return 0;
+}
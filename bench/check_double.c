@@ -0,0 +1,91 @@
+//小数输出的回归检查：print_json的结果要能用strtod精确还原，并且和%.17g逐个试出来的最短最近的数字一致
+//grisu2本身有极少数情况多一位或者不是最近的，所以随机样本里只要求不一致的比例很小
+//make check编译并运行，失败时返回1
+//./check_double [样本数]，默认1000000
+#include "../cjson.h"
+
+//固定种子的随机数，每次检查的样本都一样
+static uint64_t next_rand(uint64_t* seed) {
+  *seed ^= *seed << 13;
+  *seed ^= *seed >> 7;
+  *seed ^= *seed << 17;
+  return *seed;
+}
+
+//取出有效数字，去掉前后的0和小数点，指数部分不要
+static void significant(const char* str, char* out) {
+  char* start = out;
+  for(; *str && *str != 'e' && *str != 'E'; str++) {
+    if(*str >= '0' && *str <= '9' && (out != start || *str != '0')) {
+      *out++ = *str;
+    }
+  }
+  while(out > start && out[-1] == '0') {
+    out--;
+  }
+  *out = '\0';
+}
+
+//输出一个小数，和最短能还原的%.Ng比较有效数字，不能还原时返回-1
+static int check(double value, const char* expect) {
+  char json[64], shortest[40], mine[40], digits[40];
+  Cjson* arr;
+  sprintf(json, "[%.17g]", value);
+  if(!(arr = cjson_parse(json))) {
+    return -1;
+  }
+  const char* out = print_json(arr);
+  size_t len = strlen(out) - 2;
+  memcpy(mine, out + 1, len);
+  mine[len] = '\0';
+  free((void*)out);
+  deleteCjson(arr);
+  if(strtod(mine, NULL) != value) {
+    printf("%.17g printed as %s\n", value, mine);
+    return -1;
+  }
+  if(expect && strcmp(mine, expect)) {
+    printf("%.17g printed as %s, expected %s\n", value, mine, expect);
+    return -1;
+  }
+  for(int precision = 1; precision <= 17; precision++) {
+    sprintf(shortest, "%.*g", precision, value);
+    if(strtod(shortest, NULL) == value) {
+      break;
+    }
+  }
+  significant(mine, digits);
+  significant(shortest, shortest);
+  return strcmp(digits, shortest) != 0;
+}
+
+int main(int argc, char** argv) {
+  static const struct {
+    double value;
+    const char* expect;
+  } fixed[] = {{0.30000000000000004, "0.30000000000000004"}, {9.959482527319102e-04, "0.0009959482527319102"},
+    {0.1, "0.1"}, {5e-324, "5e-324"}, {1.7976931348623157e308, "1.7976931348623157e308"},
+    {2.2250738585072014e-308, "2.2250738585072014e-308"}, {123456789012345680.0, "123456789012345680.0"}};
+  long samples = argc > 1 ? atol(argv[1]) : 1000000, mismatched = 0;
+  uint64_t seed = 88172645463325252ULL;
+  for(size_t i = 0; i < sizeof(fixed) / sizeof(fixed[0]); i++) {
+    if(check(fixed[i].value, fixed[i].expect)) {
+      return 1;
+    }
+  }
+  for(long i = 0; i < samples; i++) {
+    uint64_t bits = next_rand(&seed);
+    double value;
+    memcpy(&value, &bits, sizeof(value));
+    if(!isfinite(value)) {
+      continue;
+    }
+    int res = check(value, NULL);
+    if(res < 0) {
+      return 1;
+    }
+    mismatched += res;
+  }
+  printf("%ld samples, %.3f%% not shortest and closest\n", samples, samples ? mismatched * 100.0 / samples : 0.0);
+  return mismatched * 100 > samples ? 1 : 0; //超过1%说明取整坏了
+}
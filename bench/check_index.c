@@ -0,0 +1,117 @@
+//键名索引和元素数组的并发检查：建过索引的object和建过元素数组的array被add_next改过之后当作只读的树共享，
+//多个线程同时查找；第一个发现过期的线程重建，别的线程可能还在读过期的那个，都不能提前释放
+//make check用-fsanitize=thread编译并运行，有数据竞争或者查找结果不对时返回1
+//./check_index [线程数] [轮数]，默认4个线程，20轮
+#include "../cjson.h"
+#include <pthread.h>
+
+#define MEMBERS 64
+
+static Cjson* obj;
+static Cjson* arr;
+static int added; //每轮在object和array的中间各插入一个，读的线程要能找到已经插入的所有成员和元素
+static bool failed;
+static pthread_barrier_t start; //读的线程一起开始，多核时尽量同时发现索引过期
+
+//创建一个整数成员，键名和节点一样用malloc分配，deleteCjson释放
+static Cjson* member(const char* key, int64_t num) {
+  Cjson* item = create_number_node();
+  item->isInt = true;
+  item->value.intNum = num;
+  if(key) {
+    item->keyName = (char*)malloc(strlen(key) + 1);
+    strcpy(item->keyName, key);
+  }
+  return item;
+}
+
+//array里第i个元素应该的值：前11个不变，后面是倒着插入的-added+1到0，再后面是原来的元素
+static int64_t expected_item(int i) {
+  if(i <= 10) {
+    return i;
+  }
+  return i <= 10 + added ? -(added - (i - 10)) : i - added;
+}
+
+//查找所有成员和元素，值不对时记下失败
+static void* reader(void* arg) {
+  char key[32];
+  (void)arg;
+  pthread_barrier_wait(&start);
+  for(int i = 0; i < MEMBERS; i++) {
+    sprintf(key, "k%d", i);
+    Cjson* item = cjson_get(obj, key);
+    if(!item || item->value.intNum != i) {
+      __atomic_store_n(&failed, true, __ATOMIC_RELAXED);
+    }
+  }
+  for(int i = 0; i < added; i++) {
+    sprintf(key, "mid%d", i);
+    Cjson* item = cjson_get(obj, key);
+    if(!item || item->value.intNum != -i) {
+      __atomic_store_n(&failed, true, __ATOMIC_RELAXED);
+    }
+  }
+  for(int i = 0; i < MEMBERS + added; i++) {
+    Cjson* item = cjson_array_get(arr, i);
+    if(!item || item->value.intNum != expected_item(i)) {
+      __atomic_store_n(&failed, true, __ATOMIC_RELAXED);
+    }
+  }
+  if(cjson_array_size(arr) != (size_t)(MEMBERS + added) || cjson_array_get(arr, MEMBERS + added)) {
+    __atomic_store_n(&failed, true, __ATOMIC_RELAXED);
+  }
+  return NULL;
+}
+
+int main(int argc, char** argv) {
+  int threads = argc > 1 ? atoi(argv[1]) : 4, rounds = argc > 2 ? atoi(argv[2]) : 20;
+  pthread_t ids[64];
+  char key[32];
+  Cjson* last = NULL;
+  if(threads < 1 || threads > 64) {
+    threads = 4;
+  }
+  pthread_barrier_init(&start, NULL, threads);
+  obj = create_object_node();
+  arr = create_array_node();
+  for(int i = 0; i < MEMBERS; i++) {
+    sprintf(key, "k%d", i);
+    Cjson* item = member(key, i);
+    if(last) {
+      add_next(last, item);
+    } else {
+      obj->child = item;
+    }
+    last = item;
+  }
+  last = NULL;
+  for(int i = 0; i < MEMBERS; i++) {
+    Cjson* item = member(NULL, i);
+    if(last) {
+      add_next(last, item);
+    } else {
+      arr->child = item;
+    }
+    last = item;
+  }
+  for(int round = 0; round < rounds; round++) {
+    cjson_get(obj, "k0"); //建索引和元素数组
+    cjson_array_get(arr, 0);
+    sprintf(key, "mid%d", round);
+    add_next(cjson_get(obj, "k10"), member(key, -round)); //在中间插入，索引和元素数组过期
+    add_next(cjson_array_get(arr, 10), member(NULL, -round));
+    added = round + 1;
+    for(int i = 0; i < threads; i++) {
+      pthread_create(&ids[i], NULL, reader, NULL);
+    }
+    for(int i = 0; i < threads; i++) {
+      pthread_join(ids[i], NULL);
+    }
+  }
+  deleteCjson(obj);
+  deleteCjson(arr);
+  pthread_barrier_destroy(&start);
+  printf("%d threads, %d rounds, %s\n", threads, rounds, failed ? "wrong lookup" : "ok");
+  return failed ? 1 : 0;
+}
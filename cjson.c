@@ -1,48 +1,705 @@
 #include "cjson.h"
 
-static const char* parse_value(const char* str, Cjson* out); //分析函数总入口
-static const char* parse_object(const char* str, Cjson* out); //解析对象
-static const char* parse_string(const char* str, Cjson* out); //解析字符串
-static const char* parse_number(const char* str, Cjson* out); //分析数字
-static const char* parse_array(const char* str, Cjson* out); //解析数组
+//解析栈上的一层，正在解析的object或array
+typedef struct {
+  Cjson* container; //SAX模式下为NULL
+  Cjson* last; //最后一个成员，新成员链在它后面
+  uint32_t count; //成员个数
+  bool isObject;
+} parse_frame_t;
+
+//解析进行到哪一步
+typedef enum {
+  PARSE_VALUE = 0, //下一个是值
+  PARSE_FIRST, //刚进入容器，下一个是第一个成员或者右括号
+  PARSE_KEY, //下一个是object的键名
+  PARSE_NEXT, //值结束，下一个是逗号或者右括号
+  PARSE_DONE
+} parse_state_t;
+
+//解析错误，只记下第一个
+typedef struct {
+  const char* pos; //出错的位置
+  const char* reason; //静态字符串
+} parse_error_t;
+
+//解析过程中的状态
+typedef struct {
+  CjsonContext* mem; //分配节点和临时空间用的上下文
+  CjsonArena* arena; //不为NULL时节点和字符串都分配在arena里
+  CjsonKeyTable* keys; //不为NULL时键名放到键名表里共用
+  uint32_t keyRefs; //这次解析引用了多少次键名表，解析完一起加到表的引用计数上
+  parse_state_t state;
+  Cjson* root;
+  parse_frame_t* stack; //还没结束的容器，代替递归
+  size_t depth;
+  size_t stackCap;
+  size_t maxDepth;
+  const char* key; //解码好的键名，等着和值一起放进节点
+  size_t keyLen;
+  char* scratch; //解码键名用的临时空间
+  size_t scratchLen;
+  const char* end; //流式解析时这块输入的结尾，为NULL时输入以\0结尾
+  bool final; //流式解析时后面没有更多输入
+  size_t checked; //流式解析时下一个token已经确认过的长度，下次接着往后找
+  const CjsonSaxHandler* sax; //不为NULL时只发事件，不建树
+  void* saxData; //传给回调的参数
+  bool stopped; //回调要求停止解析
+  bool insitu; //键名和字符串在输入缓冲区里原地解码
+  parse_error_t error;
+  const char* start; //算出错位置用的起点，流式解析时是carry的开头
+  size_t baseOffset; //start在整个输入里的偏移
+  size_t baseLine; //start所在的行和列
+  size_t baseColumn;
+  parse_frame_t localStack[32]; //嵌套不深时不用分配
+  char localScratch[128];
+} parse_context_t;
+
+//流式解析器，没用完的输入留在carry里和下一块拼起来
+struct _cjson_parser {
+  parse_context_t ctx;
+  char* carry;
+  size_t carryLen;
+  size_t carryCap;
+};
+
+static void parser_init(CjsonParser* p, CjsonContext* mem); //初始化流式解析器
+static void parser_release(CjsonParser* p); //释放流式解析器里的树和临时空间
+static Cjson* parse_insitu_n(CjsonContext* mem, char* buf, size_t size); //按长度原地解析，不读buf + size后面的字节
+static bool parser_carry(CjsonParser* p, const char* buf, size_t len); //没解析完的输入追加到carry后面
+
+static size_t parse_max_depth = CJSON_NESTING_LIMIT; //最大嵌套层数
+static __thread CjsonError last_error; //当前线程最近一次解析的错误
+
+static void parse_init(parse_context_t* ctx, CjsonContext* mem); //初始化解析状态
+static Cjson* parse_document(const char* str, parse_context_t* ctx); //解析整个文档
+static void parse_release(parse_context_t* ctx); //释放解析用的临时空间
+static const char* parse_fail(parse_error_t* err, const char* pos, const char* reason); //记下错误，返回NULL
+static void parse_abort(parse_context_t* ctx, CjsonError* out); //解析出错，释放解析了一半的树
+static void parse_advance(parse_context_t* ctx, const char* pos); //把算行列的起点移到pos
+static void parse_report(const char* reason); //开始解析之前的错误，位置记为输入开头
+static const char* parse_run(const char* ptr, parse_context_t* ctx); //按状态解析，代替递归
+static void parse_attach(parse_context_t* ctx, Cjson* item); //新节点挂到当前容器
+static bool parse_push(parse_context_t* ctx, Cjson* container, bool isObject, const char* pos); //进入容器
+static void parse_pop(parse_context_t* ctx); //容器结束
+static bool parse_ready(const char** ptr, parse_context_t* ctx); //流式解析时下一步的输入是否完整
+static const char* ready_string(const char* str, parse_context_t* ctx); //流式解析时字符串是否完整
+static const char* parse_key(const char* str, parse_context_t* ctx); //解析键名和冒号
+static const char* parse_scratch(const char* str, parse_context_t* ctx); //解码字符串到scratch里
+static const char* sax_value(const char* str, nodetype_t* type, parse_context_t* ctx); //解析一个值并发出事件
+static void sax_result(parse_context_t* ctx, bool goOn); //回调返回false时停止解析
+static const char* parse_value(const char* str, Cjson** out,
+  const char* key, size_t keyLen, parse_context_t* ctx); //解析一个值
+static const char* scan_string(const char* str, size_t* len, parse_error_t* err); //计算字符串长度
+static const char* decode_string(const char* str, char* out_ptr, size_t* outLen, parse_error_t* err); //解码字符串
+static const char* match_literal(const char* str, const char* word, parse_error_t* err); //检查true，false，null
+static const char* parse_number(const char* str, Cjson* out, parse_context_t* ctx); //分析数字
+static bool parse_number_slow(const char* str, const char* end, double* out, CjsonContext* mem); //strtod解析难处理的小数
+static void* parse_alloc(parse_context_t* ctx, size_t size); //解析时分配内存
+static Cjson* parse_new_node(parse_context_t* ctx, size_t extra); //解析时创建节点
+static void keytable_release(CjsonKeyTable* table, uint32_t refs); //放掉键名表的引用
 static Cjson* assign_simple_type_node(Cjson* item, 
-  nodetype_t nodeType, const char * cpString); //填充null，false，true节点
+  nodetype_t nodeType, const char * cpString, parse_context_t* ctx); //填充null，false，true节点
 static void set_nodeType(Cjson* item, nodetype_t nodeType); //设置nodeType属性
-static int compute_hex(const char**); //计算utf-16的值，计算前导代理和后尾代理
+static int compute_hex(const char**); //计算utf-16的值，计算前导代理和后尾代理，不是十六进制时返回-1
+static Cjson* link_next(Cjson* cur, Cjson* next); //链接下一个节点
+typedef struct _cjson_cache cjson_cache_t; //键名索引和元素数组共用的头
+static cjson_index_t* build_index(Cjson* obj, CjsonArena* arena, CjsonContext* mem, cjson_cache_t* stale); //给object建键名索引
+static cjson_cache_t* cache_publish(cjson_cache_t** slot, cjson_cache_t* cache, cjson_cache_t* stale); //挂上建好的索引或者元素数组
+static void cache_free(cjson_cache_t* cache); //释放索引或者元素数组和换下来的
+static cjson_vector_t* build_vector(Cjson* arr, CjsonArena* arena, CjsonContext* mem, cjson_cache_t* stale); //给array建元素数组
+static void free_node(Cjson* out, CjsonContext* mem); //释放单个节点
+static Cjson* object_lookup(const Cjson* obj, const char* key, bool interned, CjsonContext* mem); //查找object的成员
+static Cjson* object_find(const Cjson* obj, const char* key, const uint32_t* hash, bool interned, CjsonContext* mem); //查找成员，可以带上算好的哈希
+static Cjson* array_at(const Cjson* arr, size_t i, CjsonContext* mem); //取array的第i个元素，mem为NULL时不建元素数组
 static const char* skip_space(const char* str); // 跳过空白格
-static char* cjson_strcopy(const char* src); //复制字符串节点
-static const char* print_simple_node(const Cjson* out); //输出简单节点
-static const char* print_string(const Cjson* out); //输出string节点
-static const char* print_unicode(const char* str, char* des); //输出unicode
-static const char* print_number(const Cjson* out); //输出数字的json
-static const char* print_array(const Cjson* out); //输出array的json
-static const char* print_object(const Cjson* out); //输出object的json
-#define print_null(out) print_simple_node(out)   //输出null节点
-#define print_true(out) print_simple_node(out)//输出true节点
-#define print_false(out) print_simple_node(out)//输出false节点
-
-static void* (*cjson_malloc) (size_t size) = malloc;  //malloc
-static void (*cjson_free) (void *ptr) = free;  //free
+static const char* skip_space_to(const char* str, const char* end); //跳过空白，不越过end
+static const char* parse_skip(const char* str, const parse_context_t* ctx); //解析时跳过空白，流式解析时不越过这块输入
+
+//输出缓冲区，所有print函数都直接写到同一块缓冲区里
+//有sink时缓冲区大小固定，写满了就交给sink，整个输出不会同时放在内存里
+typedef struct {
+  char* buffer;
+  size_t length; //缓冲区容量
+  size_t offset; //已经写入的长度
+  bool noalloc; //调用者提供的缓冲区，不能扩容
+  CjsonContext* mem; //缓冲区和输出栈用的allocator
+  cjson_write_fn sink; //流式输出的写函数，为NULL时输出到一整块内存
+  void* sinkData;
+  int indent; //缩进的空格数，0是紧凑输出
+  bool sortKeys; //object的成员按键名排序
+  bool asciiOnly; //非ascii字符输出成\uXXXX
+} printbuffer_t;
+
+//排好序的object成员，pos是原来的位置，键名相同时保持原来的顺序
+typedef struct {
+  const Cjson* node;
+  size_t pos;
+} print_member_t;
+
+//输出栈上的一层，正在输出的object或array
+typedef struct {
+  const Cjson* container;
+  print_member_t* order; //排序输出时成员的顺序，为NULL时按next的顺序
+  size_t index; //order里正在输出的成员
+  size_t count;
+} print_frame_t;
+
+static void print_setup(printbuffer_t* p, CjsonContext* mem, const CjsonPrintOptions* opts); //按输出选项初始化缓冲区
+static bool print_stream(CjsonContext* mem, const Cjson* out, const CjsonPrintOptions* opts, cjson_write_fn write, void* userdata); //分块输出给写函数
+static bool print_flush(printbuffer_t* p); //缓冲区里的内容交给sink
+static char* ensure(printbuffer_t* p, size_t needed); //保证缓冲区剩余空间
+static bool print_bytes(printbuffer_t* p, const char* data, size_t len); //输出一段内容，流式输出时分几次写
+static bool print_newline(printbuffer_t* p, size_t depth); //缩进输出时换行并缩进depth层
+static bool print_enter(print_frame_t* frame, const Cjson* container, printbuffer_t* p); //进入容器，要排序时排好成员
+static const Cjson* print_next(print_frame_t* frame, const Cjson* cur); //容器里的下一个成员
+static int compare_member(const void* a, const void* b); //按键名比较成员
+static bool print_value(const Cjson* out, printbuffer_t* p); //输出各种类型的值
+static bool print_simple_node(const Cjson* out, printbuffer_t* p); //输出简单节点
+static bool print_string(const char* str, printbuffer_t* p); //输出string
+static int utf8_decode(const unsigned char* str, uint32_t* code); //解码一个utf-8字符，不合法时返回负数
+static void print_hex4(char* out, uint32_t code); //输出\uXXXX
+static bool print_number(const Cjson* out, printbuffer_t* p); //输出数字的json
+static int write_int64(int64_t num, char* out); //输出整数
+static int write_double(double num, char* out); //输出最短能还原的小数
+static bool print_char(printbuffer_t* p, char c); //输出一个字符
+#define print_null(out, p) print_simple_node(out, p)   //输出null节点
+#define print_true(out, p) print_simple_node(out, p)//输出true节点
+#define print_false(out, p) print_simple_node(out, p)//输出false节点
+
+static CjsonContext default_context = {malloc, free, NULL, 0}; //没有传上下文时用的，new_hook修改它
+#define cjson_malloc(size) (default_context.malloc_fn(size)) //默认上下文的malloc
+#define cjson_free(ptr) (default_context.free_fn(ptr)) //默认上下文的free
+
+//字符扫描：找字符串里下一个需要处理的字节，跳过成段的空白
+//x86上按16/32字节一组比较，运行时根据cpu选择，其他平台用逐字节的版本
+#if !defined(CJSON_NO_SIMD) && defined(__GNUC__) && (defined(__x86_64__) || (defined(__i386__) && defined(__SSE2__)))
+#define CJSON_SIMD 1
+#include <immintrin.h>
+#endif
+
+static const char* find_special_scalar(const char* str, const char* end); //找下一个引号，反斜杠或者控制字符
+static const char* skip_blank_scalar(const char* str, const char* end); //跳过空白
+static const char* (*find_special)(const char* str, const char* end) = find_special_scalar; //end不为NULL时最多找到end
+static const char* (*skip_blank)(const char* str, const char* end) = skip_blank_scalar;
+static const char* find_escape_scalar(const char* str); //输出时找下一个要转义或者检查的字节
+static const char* (*find_escape)(const char* str) = find_escape_scalar;
+
+//结构索引用的64字节块的位图，每一位对应块里的一个字节
+typedef struct {
+  uint64_t quote;
+  uint64_t backslash;
+  uint64_t structural; //{}[]:,
+  uint64_t open; //{[
+  uint64_t close; //}]
+} lazy_block_t;
+
+//逐字节算64字节块的位图
+static void lazy_masks_scalar(const char* block, lazy_block_t* m) {
+  m->quote = m->backslash = m->structural = m->open = m->close = 0;
+  for(int i = 0; i < 64; i++) {
+    uint64_t bit = (uint64_t)1 << i;
+    switch(block[i]) {
+      case '\"':
+        m->quote |= bit;
+        break;
+      case '\\':
+        m->backslash |= bit;
+        break;
+      case '{':
+      case '[':
+        m->open |= bit;
+        break;
+      case '}':
+      case ']':
+        m->close |= bit;
+        break;
+      case ':':
+      case ',':
+        m->structural |= bit;
+        break;
+      default:
+        break;
+    }
+  }
+  m->structural |= m->open | m->close;
+}
+
+static void (*lazy_masks)(const char* block, lazy_block_t* m) = lazy_masks_scalar;
+
+//逐字节找下一个引号，反斜杠或者控制字符，\0也算控制字符
+static const char* find_special_scalar(const char* str, const char* end) {
+  const unsigned char* ptr = (const unsigned char*)str;
+  if(end) {
+    while(ptr < (const unsigned char*)end && *ptr >= 32 && *ptr != '\"' && *ptr != '\\') {
+      ++ptr;
+    }
+    return (const char*)ptr;
+  }
+  while(*ptr >= 32 && *ptr != '\"' && *ptr != '\\') {
+    ++ptr;
+  }
+  return (const char*)ptr;
+}
+
+//逐字节找下一个引号，反斜杠，控制字符或者非ascii字节，\0也算控制字符
+static const char* find_escape_scalar(const char* str) {
+  const unsigned char* ptr = (const unsigned char*)str;
+  while(*ptr >= 32 && *ptr < 0x80 && *ptr != '\"' && *ptr != '\\') {
+    ++ptr;
+  }
+  return (const char*)ptr;
+}
+
+//逐字节跳过空白，和skip_space一样把所有控制字符当作空白
+static const char* skip_blank_scalar(const char* str, const char* end) {
+  const unsigned char* ptr = (const unsigned char*)str;
+  if(end) {
+    while(ptr < (const unsigned char*)end && *ptr && *ptr <= 32) {
+      ++ptr;
+    }
+    return (const char*)ptr;
+  }
+  while(*ptr && *ptr <= 32) {
+    ++ptr;
+  }
+  return (const char*)ptr;
+}
+
+#ifdef CJSON_SIMD
+//按对齐的块读取，不会跨页，所以读到\0后面也不会出错；块里\0前面的字节交给ASan检查没有意义
+//有end时只读开头在end前面的块，这样的块和end前面的字节在同一页里
+#define CJSON_NO_ASAN __attribute__((no_sanitize_address))
+
+CJSON_NO_ASAN static const char* find_special_sse2(const char* str, const char* end) {
+  const __m128i quote = _mm_set1_epi8('\"'),
+    backslash = _mm_set1_epi8('\\'),
+    control = _mm_set1_epi8(31);
+  if(end && str >= end) {
+    return end;
+  }
+  uintptr_t offset = (uintptr_t)str & 15;
+  const char* ptr = str - offset;
+  unsigned int mask;
+  for(;;) {
+    __m128i chunk = _mm_load_si128((const __m128i*)ptr);
+    __m128i hit = _mm_or_si128(
+      _mm_or_si128(_mm_cmpeq_epi8(chunk, quote), _mm_cmpeq_epi8(chunk, backslash)),
+      _mm_cmpeq_epi8(_mm_min_epu8(chunk, control), chunk)); //无符号小于32
+    mask = (unsigned int)_mm_movemask_epi8(hit) >> offset;
+    if(mask) {
+      ptr += offset + __builtin_ctz(mask);
+      return end && ptr > end ? end : ptr;
+    }
+    ptr += 16;
+    offset = 0;
+    if(end && ptr >= end) {
+      return end;
+    }
+  }
+}
+
+CJSON_NO_ASAN static const char* skip_blank_sse2(const char* str, const char* end) {
+  const __m128i one = _mm_set1_epi8(1),
+    limit = _mm_set1_epi8(31);
+  if(end && str >= end) {
+    return end;
+  }
+  uintptr_t offset = (uintptr_t)str & 15;
+  const char* ptr = str - offset;
+  unsigned int mask;
+  for(;;) {
+    __m128i chunk = _mm_sub_epi8(_mm_load_si128((const __m128i*)ptr), one); //1到32变成0到31
+    __m128i blank = _mm_cmpeq_epi8(_mm_min_epu8(chunk, limit), chunk);
+    mask = (~(unsigned int)_mm_movemask_epi8(blank) & 0xffff) >> offset;
+    if(mask) {
+      ptr += offset + __builtin_ctz(mask);
+      return end && ptr > end ? end : ptr;
+    }
+    ptr += 16;
+    offset = 0;
+    if(end && ptr >= end) {
+      return end;
+    }
+  }
+}
+
+__attribute__((target("avx2"))) CJSON_NO_ASAN
+static const char* find_special_avx2(const char* str, const char* end) {
+  const __m256i quote = _mm256_set1_epi8('\"'),
+    backslash = _mm256_set1_epi8('\\'),
+    control = _mm256_set1_epi8(31);
+  if(end && str >= end) {
+    return end;
+  }
+  uintptr_t offset = (uintptr_t)str & 31;
+  const char* ptr = str - offset;
+  unsigned int mask;
+  for(;;) {
+    __m256i chunk = _mm256_load_si256((const __m256i*)ptr);
+    __m256i hit = _mm256_or_si256(
+      _mm256_or_si256(_mm256_cmpeq_epi8(chunk, quote), _mm256_cmpeq_epi8(chunk, backslash)),
+      _mm256_cmpeq_epi8(_mm256_min_epu8(chunk, control), chunk));
+    mask = (unsigned int)_mm256_movemask_epi8(hit) >> offset;
+    if(mask) {
+      ptr += offset + __builtin_ctz(mask);
+      return end && ptr > end ? end : ptr;
+    }
+    ptr += 32;
+    offset = 0;
+    if(end && ptr >= end) {
+      return end;
+    }
+  }
+}
+
+//非ascii字节的最高位是1，直接用movemask取出来
+CJSON_NO_ASAN static const char* find_escape_sse2(const char* str) {
+  const __m128i quote = _mm_set1_epi8('\"'),
+    backslash = _mm_set1_epi8('\\'),
+    control = _mm_set1_epi8(31);
+  uintptr_t offset = (uintptr_t)str & 15;
+  const char* ptr = str - offset;
+  for(;;) {
+    __m128i chunk = _mm_load_si128((const __m128i*)ptr);
+    __m128i hit = _mm_or_si128(
+      _mm_or_si128(_mm_cmpeq_epi8(chunk, quote), _mm_cmpeq_epi8(chunk, backslash)),
+      _mm_cmpeq_epi8(_mm_min_epu8(chunk, control), chunk));
+    unsigned int mask = ((unsigned int)_mm_movemask_epi8(hit) | (unsigned int)_mm_movemask_epi8(chunk)) >> offset;
+    if(mask) {
+      return ptr + offset + __builtin_ctz(mask);
+    }
+    ptr += 16;
+    offset = 0;
+  }
+}
+
+__attribute__((target("avx2"))) CJSON_NO_ASAN
+static const char* find_escape_avx2(const char* str) {
+  const __m256i quote = _mm256_set1_epi8('\"'),
+    backslash = _mm256_set1_epi8('\\'),
+    control = _mm256_set1_epi8(31);
+  uintptr_t offset = (uintptr_t)str & 31;
+  const char* ptr = str - offset;
+  for(;;) {
+    __m256i chunk = _mm256_load_si256((const __m256i*)ptr);
+    __m256i hit = _mm256_or_si256(
+      _mm256_or_si256(_mm256_cmpeq_epi8(chunk, quote), _mm256_cmpeq_epi8(chunk, backslash)),
+      _mm256_cmpeq_epi8(_mm256_min_epu8(chunk, control), chunk));
+    unsigned int mask = ((unsigned int)_mm256_movemask_epi8(hit) | (unsigned int)_mm256_movemask_epi8(chunk)) >> offset;
+    if(mask) {
+      return ptr + offset + __builtin_ctz(mask);
+    }
+    ptr += 32;
+    offset = 0;
+  }
+}
+
+__attribute__((target("avx2"))) CJSON_NO_ASAN
+static const char* skip_blank_avx2(const char* str, const char* end) {
+  const __m256i one = _mm256_set1_epi8(1),
+    limit = _mm256_set1_epi8(31);
+  if(end && str >= end) {
+    return end;
+  }
+  uintptr_t offset = (uintptr_t)str & 31;
+  const char* ptr = str - offset;
+  unsigned int mask;
+  for(;;) {
+    __m256i chunk = _mm256_sub_epi8(_mm256_load_si256((const __m256i*)ptr), one);
+    __m256i blank = _mm256_cmpeq_epi8(_mm256_min_epu8(chunk, limit), chunk);
+    mask = ~(unsigned int)_mm256_movemask_epi8(blank) >> offset;
+    if(mask) {
+      ptr += offset + __builtin_ctz(mask);
+      return end && ptr > end ? end : ptr;
+    }
+    ptr += 32;
+    offset = 0;
+    if(end && ptr >= end) {
+      return end;
+    }
+  }
+}
+
+//按16字节一组算64字节块的位图，block总是完整的64字节
+static void lazy_masks_sse2(const char* block, lazy_block_t* m) {
+  const __m128i quote = _mm_set1_epi8('\"'),
+    backslash = _mm_set1_epi8('\\'),
+    colon = _mm_set1_epi8(':'),
+    comma = _mm_set1_epi8(','),
+    leftBracket = _mm_set1_epi8('['),
+    rightBracket = _mm_set1_epi8(']'),
+    leftBrace = _mm_set1_epi8('{'),
+    rightBrace = _mm_set1_epi8('}');
+  m->quote = m->backslash = m->structural = m->open = m->close = 0;
+  for(int i = 0; i < 4; i++) {
+    __m128i chunk = _mm_loadu_si128((const __m128i*)(block + i * 16));
+    __m128i open = _mm_or_si128(_mm_cmpeq_epi8(chunk, leftBracket), _mm_cmpeq_epi8(chunk, leftBrace)),
+      close = _mm_or_si128(_mm_cmpeq_epi8(chunk, rightBracket), _mm_cmpeq_epi8(chunk, rightBrace)),
+      separator = _mm_or_si128(_mm_cmpeq_epi8(chunk, colon), _mm_cmpeq_epi8(chunk, comma));
+    m->quote |= (uint64_t)(unsigned int)_mm_movemask_epi8(_mm_cmpeq_epi8(chunk, quote)) << (i * 16);
+    m->backslash |= (uint64_t)(unsigned int)_mm_movemask_epi8(_mm_cmpeq_epi8(chunk, backslash)) << (i * 16);
+    m->open |= (uint64_t)(unsigned int)_mm_movemask_epi8(open) << (i * 16);
+    m->close |= (uint64_t)(unsigned int)_mm_movemask_epi8(close) << (i * 16);
+    m->structural |= (uint64_t)(unsigned int)_mm_movemask_epi8(separator) << (i * 16);
+  }
+  m->structural |= m->open | m->close;
+}
+#endif
+
+//选择扫描的实现，CJSON_SCAN_AUTO按cpu支持的指令集选最快的
+void cjson_set_scan_mode(cjson_scan_mode_t mode) {
+  find_special = find_special_scalar;
+  skip_blank = skip_blank_scalar;
+  find_escape = find_escape_scalar;
+  lazy_masks = lazy_masks_scalar;
+#ifdef CJSON_SIMD
+  __builtin_cpu_init();
+  bool avx2 = __builtin_cpu_supports("avx2");
+  if(mode == CJSON_SCAN_AVX2 && !avx2) {
+    mode = CJSON_SCAN_SSE2; //不支持时退到sse2
+  }
+  if(mode == CJSON_SCAN_AVX2 || (mode == CJSON_SCAN_AUTO && avx2)) {
+    find_special = find_special_avx2;
+    skip_blank = skip_blank_avx2;
+    find_escape = find_escape_avx2;
+  } else if(mode != CJSON_SCAN_SCALAR) {
+    find_special = find_special_sse2;
+    skip_blank = skip_blank_sse2;
+    find_escape = find_escape_sse2;
+  }
+  if(mode != CJSON_SCAN_SCALAR) {
+    lazy_masks = lazy_masks_sse2;
+  }
+#endif
+}
+
+#ifdef CJSON_SIMD
+//程序启动时选好实现，之后多个线程同时解析只读这些函数指针
+__attribute__((constructor)) static void scan_mode_init(void) {
+  cjson_set_scan_mode(CJSON_SCAN_AUTO);
+}
+#endif
 
 //更改allocator
 void new_hook(NewHook *hook) {
   if(!hook) {
-    cjson_malloc = malloc;
-    cjson_free = free;
+    default_context.malloc_fn = malloc;
+    default_context.free_fn = free;
+    return ;
+  }
+  if(hook->free_fn)
+    default_context.free_fn = hook->free_fn;
+  if(hook->malloc_fn)
+    default_context.malloc_fn = hook->malloc_fn;
+}
+
+//初始化上下文，hook为NULL时用malloc和free；每个线程可以用自己的上下文和allocator
+void cjson_context_init(CjsonContext* mem, const NewHook* hook) {
+  memset(mem, 0, sizeof(CjsonContext));
+  mem->malloc_fn = hook && hook->malloc_fn ? hook->malloc_fn : malloc;
+  mem->free_fn = hook && hook->free_fn ? hook->free_fn : free;
+}
+
+//释放上下文里保留的临时空间，上下文分配的树不受影响
+void cjson_context_release(CjsonContext* mem) {
+  if(mem->scratch) {
+    mem->free_fn(mem->scratch);
+    mem->scratch = NULL;
+    mem->scratchLen = 0;
+  }
+}
+
+//创建arena，blockSize为0时用默认大小，没有内存时返回NULL
+CjsonArena* cjson_arena_new(size_t blockSize) {
+  CjsonArena* arena = (CjsonArena*)cjson_malloc(sizeof(CjsonArena));
+  if(!arena) {
+    return NULL;
+  }
+  memset(arena, 0, sizeof(CjsonArena));
+  arena->blockSize = blockSize ? blockSize : CJSON_ARENA_BLOCK_SIZE;
+  arena->malloc_fn = default_context.malloc_fn; //记下创建时的allocator，之后new_hook不影响这个arena
+  arena->free_fn = default_context.free_fn;
+  return arena;
+}
+
+//从arena里分配，按8字节对齐，没有内存时返回NULL
+void* cjson_arena_alloc(CjsonArena* arena, size_t size) {
+  CjsonArenaBlock* block = arena->head;
+  size = (size + 7) & ~(size_t)7;
+  if(!block || block->size - block->used < size) {
+    size_t blockSize = arena->blockSize;
+    if(size > blockSize / 4) {
+      blockSize = size; //大块单独分配，避免浪费当前块的剩余空间
+    }
+    block = (CjsonArenaBlock*)arena->malloc_fn(sizeof(CjsonArenaBlock) + blockSize);
+    if(!block) {
+      return NULL;
+    }
+    block->size = blockSize;
+    block->used = 0;
+    if(arena->head && blockSize == size) {
+      block->next = arena->head->next; //大块挂在当前块后面，当前块还能继续用
+      arena->head->next = block;
+    } else {
+      block->next = arena->head;
+      arena->head = block;
+    }
+  }
+  void* res = (char*)(block + 1) + block->used;
+  block->used += size;
+  return res;
+}
+
+//释放arena，arena里的整棵树随之释放
+void cjson_arena_free(CjsonArena* arena) {
+  if(!arena) {
+    return ;
+  }
+  CjsonArenaBlock* block = arena->head;
+  while(block) {
+    CjsonArenaBlock* next = block->next;
+    arena->free_fn(block);
+    block = next;
+  }
+  arena->free_fn(arena);
+}
+
+//键名表里每个键名前面的头，键名本身紧跟在后面
+typedef struct {
+  CjsonKeyTable* table;
+  uint32_t hash;
+  uint32_t len;
+} cjson_key_header_t;
+
+//键名表，同样的键名只存一份，节点引用时给表加引用计数
+struct _cjson_key_table {
+  uint32_t refCount; //创建者一份，加上引用键名的节点数
+  uint32_t count;
+  uint32_t mask;
+  const char** slots; //指向键名，开放寻址
+  CjsonArena* storage; //键名都放在这里
+  void* (*malloc_fn) (size_t size);
+  void (*free_fn) (void *);
+};
+
+#define key_header(key) ((cjson_key_header_t*)(key) - 1)
+
+//创建键名表，没有内存时返回NULL
+CjsonKeyTable* cjson_keytable_new(void) {
+  CjsonKeyTable* table = (CjsonKeyTable*)cjson_malloc(sizeof(CjsonKeyTable));
+  if(!table) {
+    return NULL;
+  }
+  memset(table, 0, sizeof(CjsonKeyTable));
+  table->refCount = 1;
+  table->mask = 63;
+  table->malloc_fn = default_context.malloc_fn;
+  table->free_fn = default_context.free_fn;
+  table->slots = (const char**)cjson_malloc((table->mask + 1) * sizeof(const char*));
+  table->storage = cjson_arena_new(4096);
+  if(!table->slots || !table->storage) {
+    if(table->slots)
+      cjson_free(table->slots);
+    cjson_arena_free(table->storage);
+    cjson_free(table);
+    return NULL;
+  }
+  memset(table->slots, 0, (table->mask + 1) * sizeof(const char*));
+  return table;
+}
+
+//放掉引用，最后一个引用放掉时释放整张表
+static void keytable_release(CjsonKeyTable* table, uint32_t refs) {
+  if(__atomic_sub_fetch(&table->refCount, refs, __ATOMIC_ACQ_REL) != 0) {
     return ;
   }
-  hook->free_fn && (cjson_free = hook->free_fn);
-  hook->malloc_fn && (cjson_malloc = hook->malloc_fn);
+  cjson_arena_free(table->storage);
+  table->free_fn(table->slots);
+  table->free_fn(table);
+}
+
+//创建者不再使用这张表，还在用表里键名的树删除后才真正释放
+void cjson_keytable_free(CjsonKeyTable* table) {
+  if(table) {
+    keytable_release(table, 1);
+  }
+}
+
+//表满到3/4时扩容，没有内存时返回false，表保持原样
+static bool keytable_grow(CjsonKeyTable* table) {
+  uint32_t mask = table->mask * 2 + 1;
+  const char** slots = (const char**)table->malloc_fn((mask + 1) * sizeof(const char*));
+  if(!slots) {
+    return false;
+  }
+  memset(slots, 0, (mask + 1) * sizeof(const char*));
+  for(uint32_t i = 0; i <= table->mask; i++) {
+    const char* key = table->slots[i];
+    if(!key)
+      continue;
+    uint32_t pos = key_header(key)->hash & mask;
+    while(slots[pos])
+      pos = (pos + 1) & mask;
+    slots[pos] = key;
+  }
+  table->free_fn(table->slots);
+  table->slots = slots;
+  table->mask = mask;
+  return true;
+}
+
+//查找长度为len的键名，没有就加进表里，返回表里的那一份，没有内存时返回NULL
+static const char* keytable_intern(CjsonKeyTable* table, const char* key, size_t len) {
+  uint32_t hash = 2166136261u;
+  for(size_t i = 0; i < len; i++) {
+    hash = (hash ^ (unsigned char)key[i]) * 16777619u;
+  }
+  if((table->count + 1) * 4 >= (table->mask + 1) * 3 && !keytable_grow(table) &&
+    table->count >= table->mask) {
+    return NULL; //扩容失败，表里只剩一个空位，留着它让查找能停下来
+  }
+  uint32_t pos = hash & table->mask;
+  while(table->slots[pos]) {
+    const char* cur = table->slots[pos];
+    if(key_header(cur)->hash == hash && key_header(cur)->len == len && memcmp(cur, key, len) == 0) {
+      return cur;
+    }
+    pos = (pos + 1) & table->mask;
+  }
+  cjson_key_header_t* header = (cjson_key_header_t*)cjson_arena_alloc(table->storage,
+    sizeof(cjson_key_header_t) + len + 1);
+  if(!header) {
+    return NULL;
+  }
+  char* res = (char*)(header + 1);
+  header->table = table;
+  header->hash = hash;
+  header->len = (uint32_t)len;
+  memcpy(res, key, len);
+  res[len] = '\0';
+  table->slots[pos] = res;
+  table->count++;
+  return res;
+}
+
+//取得键名在表里的那一份，可以拿去给cjson_get_interned按指针比较
+const char* cjson_keytable_intern(CjsonKeyTable* table, const char* key) {
+  return keytable_intern(table, key, strlen(key));
 }
 
 //创建新节点
 Cjson* create_new_node(nodetype_t nodeType) {
+  return create_new_node_ctx(&default_context, nodeType);
+}
+
+//用上下文的allocator创建新节点，要用同一个上下文的deleteCjson_ctx释放，没有内存时返回NULL
+Cjson* create_new_node_ctx(CjsonContext* mem, nodetype_t nodeType) {
   static const size_t Cjson_size = sizeof(Cjson);
-  Cjson* item = (Cjson*)cjson_malloc(Cjson_size);
+  Cjson* item = (Cjson*)mem->malloc_fn(Cjson_size);
   if(!item) {
-    printf("error in create_new_node method\n");
-    exit(1);
-  }  
+    return NULL;
+  }
   memset(item, 0, Cjson_size);
   if(nodeType) 
     item->nodeType = nodeType;
@@ -52,117 +709,919 @@ Cjson* create_new_node(nodetype_t nodeType) {
 
 //创建新节点并且赋值，适用于object，array，number以外的类型
 Cjson* create_simple_type_node(nodetype_t nodeType, const char * cpString) {
-  Cjson* item = create_new_node(nodeType);
-  item = assign_simple_type_node(item, nodeType, cpString);
+  return create_simple_type_node_ctx(&default_context, nodeType, cpString);
+}
+
+//用上下文的allocator创建简单节点
+Cjson* create_simple_type_node_ctx(CjsonContext* mem, nodetype_t nodeType, const char * cpString) {
+  parse_context_t ctx;
+  Cjson* item = create_new_node_ctx(mem, nodeType);
+  if(!item) {
+    return NULL;
+  }
+  ctx.arena = NULL;
+  ctx.mem = mem;
+  if(!assign_simple_type_node(item, nodeType, cpString, &ctx)) {
+    mem->free_fn(item);
+    return NULL;
+  }
   return item;
 }
 
-//填充null，false，true节点
-static Cjson* assign_simple_type_node(Cjson* item, nodetype_t nodeType, const char * cpString) {
+//填充null，false，true，string节点，null，false，true不需要分配内存，没有内存时返回NULL
+static Cjson* assign_simple_type_node(Cjson* item, nodetype_t nodeType, const char * cpString, parse_context_t* ctx) {
+  if(nodeType != NodeType_STRING) {
+    item->value.complex = NULL; //字面量由print_simple_node按类型输出
+    return item;
+  }
   const size_t len = strlen(cpString);
-  item->value.complex = (char*)cjson_malloc(len + 1);
-  strncpy(item->value.complex, cpString, len);
-  *(item->value.complex + len) = '\0';
+  item->value.complex = (char*)parse_alloc(ctx, len + 1);
+  if(!item->value.complex) {
+    return NULL;
+  }
+  memcpy(item->value.complex, cpString, len + 1);
+  return item;
+}
+
+//解析时分配内存，没有arena时用上下文的allocator，没有内存时返回NULL，由调用者报错
+static void* parse_alloc(parse_context_t* ctx, size_t size) {
+  if(ctx->arena) {
+    return cjson_arena_alloc(ctx->arena, size);
+  }
+  return ctx->mem->malloc_fn(size);
+}
+
+//解析时创建节点，extra是紧跟在节点后面存放键名和字符串的空间
+static Cjson* parse_new_node(parse_context_t* ctx, size_t extra) {
+  Cjson* item = (Cjson*)parse_alloc(ctx, sizeof(Cjson) + extra);
+  if(!item) {
+    return NULL;
+  }
+  memset(item, 0, sizeof(Cjson));
+  item->inArena = ctx->arena != NULL;
+  item->inlineData = extra != 0;
   return item;
 }
 
-//解析函数入口
+//解析函数入口，出错时返回NULL，原因和位置用cjson_last_error取
 Cjson* cjson_parse(const char * str) {
-  Cjson* out = create_new_node(NOTYPE);
-  const char* end = parse_value(str, out);
+  parse_context_t ctx;
+  parse_init(&ctx, &default_context);
+  return parse_document(str, &ctx);
+}
+
+//解析，出错时返回NULL，错误写到err里，成功时err的reason为NULL
+Cjson* cjson_parse_err(const char * str, CjsonError* err) {
+  Cjson* out = cjson_parse(str);
+  if(err) {
+    *err = last_error;
+  }
   return out;
 }
 
-//解析各种类型的值
-static const char* parse_value(const char* str, Cjson* out) {
-  const char *ptr = str;
-  switch (*ptr)
-  {
-    case '{':
-      set_nodeType(out, NodeType_OBJECT);
-      ptr = parse_object(str, out);
-      break;
-    case '[':
-      set_nodeType(out, NodeType_ARRAY);
-      ptr = parse_array(str, out);
-      break;
-    case 't':
-    case 'T':
-      set_nodeType(out, NodeType_TRUE);
-      out = assign_simple_type_node(out, NodeType_TRUE, "true");
-      ptr += 4;
-      break;
-    case 'f':
-    case 'F':
-      set_nodeType(out, NodeType_FALSE);
-      out = assign_simple_type_node(out, NodeType_FALSE, "false");
-      ptr += 5;
-      break;
-    case 'n':
-    case 'N':
-      set_nodeType(out, NodeType_NULL);
-      out = assign_simple_type_node(out, NodeType_NULL, "null");
-      ptr += 4;
-      break;
-    case '\"':
-      set_nodeType(out, NodeType_STRING);
-      ptr = parse_string(str, out);
-      break;
-    default:
-      if(strchr("-+0123456789e", *ptr) == 0) {
-        printf("undefined value ,error in parse_value method");
-        exit(1);
-      }
-      set_nodeType(out, NodeType_NUMBER);
-      ptr = parse_number(str, out);
-      break;
+//当前线程最近一次解析的错误，每次解析都会覆盖
+const CjsonError* cjson_last_error(void) {
+  return &last_error;
+}
+
+//解析到arena里，用cjson_arena_free释放整棵树
+Cjson* cjson_parse_arena(const char * str, CjsonArena* arena) {
+  if(!arena) {
+    parse_report("arena is NULL");
+    return NULL;
   }
-  return ptr;
-} 
+  parse_context_t ctx;
+  parse_init(&ctx, &default_context);
+  ctx.arena = arena;
+  return parse_document(str, &ctx);
+}
 
-//解析字符串
-static const char* parse_string(const char* str, Cjson* out) {
-  const char* ptr = str;
-  int len = 0;
-  if(*ptr++ != '\"') {
-    printf("error in parse_string method\n");
-    exit(1);
+//键名放到键名表里共用，表由调用者创建，可以给多次解析共用
+Cjson* cjson_parse_keytable(const char * str, CjsonKeyTable* keys) {
+  if(!keys) {
+    parse_report("key table is NULL");
+    return NULL;
   }
-  while(*ptr != '\"') {
-    if(*ptr == '\\') {
-      ++ptr;
+  parse_context_t ctx;
+  parse_init(&ctx, &default_context);
+  ctx.keys = keys;
+  __atomic_add_fetch(&keys->refCount, 1, __ATOMIC_RELAXED); //解析过程中先拿一份引用
+  Cjson* out = parse_document(str, &ctx);
+  __atomic_add_fetch(&keys->refCount, ctx.keyRefs, __ATOMIC_RELAXED); //引用计数一次加上，出错时已经加过了
+  keytable_release(keys, 1);
+  return out;
+}
+
+//这次解析里相同的键名只存一份
+Cjson* cjson_parse_interned(const char * str) {
+  CjsonKeyTable* keys = cjson_keytable_new();
+  if(!keys) {
+    parse_report("out of memory");
+    return NULL;
+  }
+  Cjson* out = cjson_parse_keytable(str, keys);
+  cjson_keytable_free(keys); //表由树里的键名引用着，树删掉后释放
+  return out;
+}
+
+//用调用者的上下文解析，节点用上下文的allocator分配，要用deleteCjson_ctx释放
+Cjson* cjson_parse_ctx(CjsonContext* mem, const char * str) {
+  parse_context_t ctx;
+  parse_init(&ctx, mem);
+  return parse_document(str, &ctx);
+}
+
+//设置最大嵌套层数，超过时解析报错
+void cjson_set_max_depth(size_t depth) {
+  parse_max_depth = depth ? depth : CJSON_NESTING_LIMIT;
+}
+
+//原地解析，键名和字符串在buf里原地解码，节点直接指向buf，buf要比树活得久
+Cjson* cjson_parse_insitu(char* buf) {
+  return cjson_parse_insitu_ctx(&default_context, buf);
+}
+
+//用上下文的allocator原地解析，节点要用deleteCjson_ctx释放
+Cjson* cjson_parse_insitu_ctx(CjsonContext* mem, char* buf) {
+  parse_context_t ctx;
+  parse_init(&ctx, mem);
+  ctx.insitu = true;
+  return parse_document(buf, &ctx);
+}
+
+//SAX方式解析，只按顺序调用handler里的回调，不建树，占用的内存只和嵌套层数有关
+//回调返回false时停止解析，这时返回false，cjson_last_error的reason为NULL；出错时也返回false
+bool cjson_parse_sax(const char * str, const CjsonSaxHandler* handler, void* userdata) {
+  return cjson_parse_sax_ctx(&default_context, str, handler, userdata);
+}
+
+//SAX解析，解码字符串和长数字用的临时内存从mem分配
+bool cjson_parse_sax_ctx(CjsonContext* mem, const char * str, const CjsonSaxHandler* handler, void* userdata) {
+  parse_context_t ctx;
+  parse_init(&ctx, mem);
+  ctx.sax = handler;
+  ctx.saxData = userdata;
+  parse_document(str, &ctx);
+  return !ctx.stopped && !ctx.error.reason;
+}
+
+//创建流式解析器，输入分块用cjson_parser_feed送进来，没有内存时返回NULL
+CjsonParser* cjson_parser_new(void) {
+  return cjson_parser_new_ctx(&default_context);
+}
+
+//用上下文的allocator创建流式解析器，解析器，carry和树都用它分配，树要用deleteCjson_ctx释放
+CjsonParser* cjson_parser_new_ctx(CjsonContext* mem) {
+  CjsonParser* p = (CjsonParser*)mem->malloc_fn(sizeof(CjsonParser));
+  if(!p) {
+    return NULL;
+  }
+  parser_init(p, mem);
+  return p;
+}
+
+//初始化流式解析器
+static void parser_init(CjsonParser* p, CjsonContext* mem) {
+  parse_init(&p->ctx, mem);
+  p->carry = NULL;
+  p->carryLen = 0;
+  p->carryCap = 0;
+}
+
+//创建发SAX事件的流式解析器，cjson_parser_finish返回NULL
+CjsonParser* cjson_parser_new_sax(const CjsonSaxHandler* handler, void* userdata) {
+  return cjson_parser_new_sax_ctx(&default_context, handler, userdata);
+}
+
+//用上下文的allocator创建发SAX事件的流式解析器
+CjsonParser* cjson_parser_new_sax_ctx(CjsonContext* mem, const CjsonSaxHandler* handler, void* userdata) {
+  CjsonParser* p = cjson_parser_new_ctx(mem);
+  if(!p) {
+    return NULL;
+  }
+  p->ctx.sax = handler;
+  p->ctx.saxData = userdata;
+  return p;
+}
+
+//送进一块输入，完整的部分马上解析，结尾不完整的token留到和下一块一起解析
+//上一块没有剩下token时直接在buf里解析，只复制结尾不完整的token，buf不需要以\0结尾
+//出错时返回false，解析了一半的树已经释放，后面再送进来的输入都不解析
+bool cjson_parser_feed(CjsonParser* p, const char* buf, size_t len) {
+  if(p->ctx.error.reason) {
+    parse_abort(&p->ctx, &last_error); //再报一次之前的错
+    return false;
+  }
+  const char* ptr;
+  if(!p->carryLen && len) {
+    p->ctx.end = buf + len;
+    p->ctx.start = buf;
+    ptr = parse_run(buf, &p->ctx);
+    if(!ptr) {
+      parse_abort(&p->ctx, &last_error);
+      return false;
     }
-    if(*ptr < 32) {
-      continue;
+    if(p->ctx.state != PARSE_DONE) { //根节点后面的内容和cjson_parse一样忽略
+      parse_advance(&p->ctx, ptr);
+      if(!parser_carry(p, ptr, (size_t)(buf + len - ptr))) {
+        return false;
+      }
     }
-    if(*ptr == 'u' && *(ptr - 1) == '\\') {
-      len--;
+    memset(&last_error, 0, sizeof(last_error));
+    return true;
+  }
+  if(!parser_carry(p, buf, len)) {
+    return false;
+  }
+  p->ctx.end = p->carry + p->carryLen;
+  p->ctx.start = p->carry;
+  ptr = parse_run(p->carry, &p->ctx);
+  if(!ptr) {
+    parse_abort(&p->ctx, &last_error);
+    return false;
+  }
+  if(p->ctx.state == PARSE_DONE) {
+    p->carryLen = 0;
+  } else {
+    parse_advance(&p->ctx, ptr); //解析过的输入要丢掉，先把它的行数记下来
+    p->carryLen = (size_t)(p->ctx.end - ptr);
+    memmove(p->carry, ptr, p->carryLen);
+  }
+  memset(&last_error, 0, sizeof(last_error));
+  return true;
+}
+
+//没解析完的输入追加到carry后面，carry只放上一块剩下的token和这一块，后面补\0
+static bool parser_carry(CjsonParser* p, const char* buf, size_t len) {
+  if(p->carryLen + len + 1 > p->carryCap) {
+    size_t cap = p->carryCap ? p->carryCap : 256;
+    while(cap < p->carryLen + len + 1) {
+      cap *= 2;
     }
-    ++len;
-    ++ptr;
-  } //计算长度,unicode长度转为utf-8为1到4位，所以就按四位来算
-  out->value.complex = (char*)cjson_malloc(len + 1); //加上\0
-  char* out_ptr = out->value.complex;  
-  ptr = str + 1;
-  while(*ptr != '\"') {
-    if(*ptr != '\\') {
-      if(*ptr >= 32)
-        *out_ptr++ = *ptr++; 
-    } else {
-      ++ptr;
-      switch(*ptr) {
-        case '/':
-          *out_ptr++ = '/';
-          break;
-        case '"': 
-          *out_ptr++ = '\"';
-          break;
-        case '\\':
-          *out_ptr++ = '\\';
-          break;
-        case 'b': 
-          *out_ptr++ = '\b';
-          break;
+    char* carry = (char*)p->ctx.mem->malloc_fn(cap);
+    if(!carry) {
+      p->ctx.start = NULL; //位置就是已经丢掉的输入的长度
+      parse_fail(&p->ctx.error, NULL, "out of memory");
+      parse_abort(&p->ctx, &last_error);
+      return false;
+    }
+    if(p->carry) {
+      memcpy(carry, p->carry, p->carryLen);
+      p->ctx.mem->free_fn(p->carry);
+    }
+    p->carry = carry;
+    p->carryCap = cap;
+  }
+  if(len) {
+    memcpy(p->carry + p->carryLen, buf, len);
+  }
+  p->carryLen += len;
+  p->carry[p->carryLen] = '\0'; //扫描函数遇到\0停下
+  return true;
+}
+
+//输入结束，返回解析好的树，树归调用者所有；出错时返回NULL，原因和位置用cjson_last_error取
+Cjson* cjson_parser_finish(CjsonParser* p) {
+  p->ctx.final = true;
+  if(!cjson_parser_feed(p, "", 0)) {
+    return NULL;
+  }
+  Cjson* root = p->ctx.root;
+  p->ctx.root = NULL;
+  return root;
+}
+
+//释放流式解析器，没有finish时连同解析了一半的树一起释放
+void cjson_parser_free(CjsonParser* p) {
+  CjsonContext* mem = p->ctx.mem;
+  parser_release(p);
+  mem->free_fn(p);
+}
+
+//释放解析了一半的树，解析栈和carry
+static void parser_release(CjsonParser* p) {
+  if(p->ctx.root) {
+    deleteCjson_ctx(p->ctx.mem, p->ctx.root);
+    p->ctx.root = NULL;
+  }
+  parse_release(&p->ctx);
+  if(p->carry) {
+    p->ctx.mem->free_fn(p->carry);
+    p->carry = NULL;
+  }
+}
+
+//按长度解析，buf后面不需要\0，buf + len和后面的字节都不会读，不完整的输入报错
+//大部分输入直接在buf里解析，只有结尾的一个token复制出来；出错时返回NULL，原因和位置用cjson_last_error取
+Cjson* cjson_parse_n(const char* buf, size_t len) {
+  return cjson_parse_n_ctx(&default_context, buf, len);
+}
+
+//用上下文的allocator按长度解析
+Cjson* cjson_parse_n_ctx(CjsonContext* mem, const char* buf, size_t len) {
+  CjsonParser p;
+  parser_init(&p, mem);
+  Cjson* root = cjson_parser_feed(&p, buf, len) ? cjson_parser_finish(&p) : NULL;
+  parser_release(&p);
+  return root;
+}
+
+//按长度原地解析，buf + size和后面的字节都不会读；走流式解析的路子，结尾的数字复制到carry里解析
+//字符串和键名在buf里原地解码，carry里只可能解析出数字，树不会指向carry
+static Cjson* parse_insitu_n(CjsonContext* mem, char* buf, size_t size) {
+  CjsonParser p;
+  parser_init(&p, mem);
+  p.ctx.insitu = true;
+  Cjson* root = cjson_parser_feed(&p, buf, size) ? cjson_parser_finish(&p) : NULL;
+  parser_release(&p);
+  return root;
+}
+
+//初始化解析状态
+static void parse_init(parse_context_t* ctx, CjsonContext* mem) {
+  memset(ctx, 0, sizeof(parse_context_t));
+  ctx->mem = mem;
+  ctx->stack = ctx->localStack;
+  ctx->stackCap = sizeof(ctx->localStack) / sizeof(ctx->localStack[0]);
+  ctx->maxDepth = parse_max_depth;
+  ctx->baseLine = 1;
+  ctx->baseColumn = 1;
+  ctx->scratch = ctx->localScratch;
+  ctx->scratchLen = sizeof(ctx->localScratch);
+  if(mem->scratchLen > ctx->scratchLen) { //上次解析留下的大块临时空间
+    ctx->scratch = mem->scratch;
+    ctx->scratchLen = mem->scratchLen;
+    mem->scratch = NULL;
+    mem->scratchLen = 0;
+  }
+}
+
+//解析整个文档，释放解析过程中用到的临时空间，出错时返回NULL并且记下错误
+static Cjson* parse_document(const char* str, parse_context_t* ctx) {
+  ctx->start = str;
+  const char* ptr = parse_run(skip_space(str), ctx);
+  parse_release(ctx);
+  if(!ptr) {
+    parse_abort(ctx, &last_error);
+    return NULL;
+  }
+  memset(&last_error, 0, sizeof(last_error));
+  return ctx->root;
+}
+
+//释放解析过程中分配的栈和临时空间
+static void parse_release(parse_context_t* ctx) {
+  if(ctx->stack != ctx->localStack) {
+    ctx->mem->free_fn(ctx->stack);
+    ctx->stack = ctx->localStack;
+  }
+  if(ctx->scratch != ctx->localScratch) {
+    if(ctx->mem != &default_context && !ctx->mem->scratch) { //调用者的上下文只有一个线程用，临时空间留给下次
+      ctx->mem->scratch = ctx->scratch;
+      ctx->mem->scratchLen = ctx->scratchLen;
+    } else {
+      ctx->mem->free_fn(ctx->scratch);
+    }
+    ctx->scratch = ctx->localScratch;
+  }
+}
+
+//记下错误，只记第一个，返回NULL让调用者直接返回
+static const char* parse_fail(parse_error_t* err, const char* pos, const char* reason) {
+  if(!err->reason) {
+    err->pos = pos;
+    err->reason = reason;
+  }
+  return NULL;
+}
+
+//解析出错：算出错误的位置写到out里，释放解析了一半的树，整个过程不分配内存
+static void parse_abort(parse_context_t* ctx, CjsonError* out) {
+  parse_advance(ctx, ctx->error.pos ? ctx->error.pos : ctx->start);
+  out->offset = ctx->baseOffset;
+  out->line = ctx->baseLine;
+  out->column = ctx->baseColumn;
+  out->reason = ctx->error.reason;
+  if(ctx->keys) { //树里的键名删除时各放掉一次引用，先加上
+    __atomic_add_fetch(&ctx->keys->refCount, ctx->keyRefs, __ATOMIC_RELAXED);
+    ctx->keyRefs = 0;
+  }
+  ctx->root = deleteCjson_ctx(ctx->mem, ctx->root);
+}
+
+//把算行列的起点从start移到pos，数一下中间的换行
+static void parse_advance(parse_context_t* ctx, const char* pos) {
+  const char* ptr = ctx->start, *line;
+  if(!ptr || pos <= ptr) {
+    return ;
+  }
+  ctx->baseOffset += pos - ptr;
+  while((line = (const char*)memchr(ptr, '\n', pos - ptr))) {
+    ++ctx->baseLine;
+    ctx->baseColumn = 1;
+    ptr = line + 1;
+  }
+  ctx->baseColumn += pos - ptr;
+  ctx->start = pos;
+}
+
+//开始解析之前的错误，位置记为输入开头
+static void parse_report(const char* reason) {
+  last_error.offset = 0;
+  last_error.line = 1;
+  last_error.column = 1;
+  last_error.reason = reason;
+}
+
+//新节点挂到当前容器的最后，栈为空时就是根节点
+static void parse_attach(parse_context_t* ctx, Cjson* item) {
+  if(!ctx->depth) {
+    ctx->root = item;
+    return ;
+  }
+  parse_frame_t* top = &ctx->stack[ctx->depth - 1];
+  if(top->last) {
+    link_next(top->last, item);
+  } else {
+    top->container->child = item;
+  }
+  top->last = item;
+  top->count++;
+}
+
+//进入一个新的容器，pos是左括号，出错时返回false
+static bool parse_push(parse_context_t* ctx, Cjson* container, bool isObject, const char* pos) {
+  if(ctx->depth >= ctx->maxDepth) {
+    parse_fail(&ctx->error, pos, "nesting is too deep");
+    return false;
+  }
+  if(ctx->depth == ctx->stackCap) { //栈按两倍扩容，最多到maxDepth
+    size_t cap = ctx->stackCap * 2;
+    parse_frame_t* stack = (parse_frame_t*)ctx->mem->malloc_fn(cap * sizeof(parse_frame_t));
+    if(!stack) {
+      parse_fail(&ctx->error, pos, "out of memory");
+      return false;
+    }
+    memcpy(stack, ctx->stack, ctx->depth * sizeof(parse_frame_t));
+    if(ctx->stack != ctx->localStack) {
+      ctx->mem->free_fn(ctx->stack);
+    }
+    ctx->stack = stack;
+    ctx->stackCap = cap;
+  }
+  parse_frame_t* top = &ctx->stack[ctx->depth++];
+  top->container = container;
+  top->last = NULL;
+  top->count = 0;
+  top->isObject = isObject;
+  return true;
+}
+
+//容器结束，很宽的object解析完直接建索引，很长的array直接建元素数组，arena里的也放在arena里
+static void parse_pop(parse_context_t* ctx) {
+  parse_frame_t* top = &ctx->stack[--ctx->depth];
+  if(ctx->sax) {
+    const CjsonSaxHandler* h = ctx->sax;
+    if(top->isObject) {
+      sax_result(ctx, !h->end_object || h->end_object(ctx->saxData));
+    } else {
+      sax_result(ctx, !h->end_array || h->end_array(ctx->saxData));
+    }
+    return ;
+  }
+  if(top->isObject) {
+#if CJSON_INDEX_EAGER_MEMBERS
+    if(top->count >= CJSON_INDEX_EAGER_MEMBERS)
+      build_index(top->container, ctx->arena, ctx->mem, NULL);
+#endif
+  } else {
+#if CJSON_VECTOR_EAGER_ITEMS
+    if(top->count >= CJSON_VECTOR_EAGER_ITEMS)
+      build_vector(top->container, ctx->arena, ctx->mem, NULL);
+#endif
+  }
+}
+
+//解码键名到scratch里，SAX模式下直接发出key事件
+static const char* parse_key(const char* str, parse_context_t* ctx) {
+  if(*str != '\"') {
+    return parse_fail(&ctx->error, str, *str ? "object member needs a name" : "unexpected end of input");
+  }
+  const char* ptr;
+  if(ctx->insitu) {
+    ptr = decode_string(str, (char*)str + 1, &ctx->keyLen, &ctx->error);
+    ctx->key = str + 1;
+  } else {
+    ptr = parse_scratch(str, ctx);
+    ctx->key = ctx->scratch;
+  }
+  if(!ptr) {
+    return NULL;
+  }
+  if(ctx->sax) {
+    sax_result(ctx, !ctx->sax->key || ctx->sax->key(ctx->saxData, ctx->key, ctx->keyLen));
+    ctx->key = NULL;
+  }
+  ptr = parse_skip(ptr, ctx);
+  if(*ptr != ':') {
+    return parse_fail(&ctx->error, ptr, "expected : after name");
+  }
+  return parse_skip(ptr + 1, ctx);
+}
+
+//解码字符串到scratch里，长度放在keyLen里，scratch不够时扩容
+static const char* parse_scratch(const char* str, parse_context_t* ctx) {
+  size_t len;
+  if(!scan_string(str, &len, &ctx->error)) {
+    return NULL;
+  }
+  if(ctx->scratchLen < len + 1) {
+    char* scratch = (char*)ctx->mem->malloc_fn(len + 64);
+    if(!scratch) {
+      return parse_fail(&ctx->error, str, "out of memory");
+    }
+    if(ctx->scratch != ctx->localScratch)
+      ctx->mem->free_fn(ctx->scratch);
+    ctx->scratch = scratch;
+    ctx->scratchLen = len + 64;
+  }
+  return decode_string(str, ctx->scratch, &ctx->keyLen, &ctx->error);
+}
+
+//用显式的栈代替递归，嵌套多深都只占用栈上固定的空间，出错时返回NULL
+static const char* parse_run(const char* ptr, parse_context_t* ctx) {
+  for(;;) {
+    if(ctx->stopped) {
+      ctx->state = PARSE_DONE;
+      return ptr;
+    }
+    if(ctx->end && !parse_ready(&ptr, ctx)) {
+      return ctx->error.reason ? NULL : ptr; //等下一块输入
+    }
+    switch(ctx->state) {
+      case PARSE_VALUE: {
+        Cjson* item = NULL;
+        const char* start = ptr;
+        nodetype_t type = NOTYPE;
+        if(ctx->sax) {
+          ptr = sax_value(ptr, &type, ctx);
+        } else {
+          ptr = parse_value(ptr, &item, ctx->key, ctx->keyLen, ctx);
+          ctx->key = NULL;
+          if(item) { //出错时建了一半的节点也挂上去，和整棵树一起释放
+            parse_attach(ctx, item);
+            type = (nodetype_t)item->nodeType;
+          }
+        }
+        if(!ptr) {
+          return NULL;
+        }
+        if(type == NodeType_OBJECT || type == NodeType_ARRAY) {
+          if(!parse_push(ctx, item, type == NodeType_OBJECT, start)) {
+            return NULL;
+          }
+          ctx->state = PARSE_FIRST;
+        } else {
+          ctx->state = PARSE_NEXT;
+        }
+        break;
+      }
+      case PARSE_FIRST: {
+        bool isObject = ctx->stack[ctx->depth - 1].isObject;
+        ptr = parse_skip(ptr, ctx);
+        if(*ptr == (isObject ? '}' : ']')) {
+          ++ptr;
+          parse_pop(ctx);
+          ctx->state = PARSE_NEXT;
+        } else {
+          ctx->state = isObject ? PARSE_KEY : PARSE_VALUE;
+        }
+        break;
+      }
+      case PARSE_KEY:
+        ptr = parse_key(ptr, ctx);
+        if(!ptr) {
+          return NULL;
+        }
+        ctx->state = PARSE_VALUE;
+        break;
+      case PARSE_NEXT: {
+        if(!ctx->depth) {
+          ctx->state = PARSE_DONE;
+          return ptr;
+        }
+        bool isObject = ctx->stack[ctx->depth - 1].isObject;
+        ptr = parse_skip(ptr, ctx);
+        if(*ptr == ',') {
+          ptr = parse_skip(ptr + 1, ctx);
+          ctx->state = isObject ? PARSE_KEY : PARSE_VALUE;
+        } else if(*ptr == (isObject ? '}' : ']')) {
+          ++ptr;
+          parse_pop(ctx);
+        } else {
+          return parse_fail(&ctx->error, ptr, !*ptr ? "unexpected end of input" :
+            isObject ? "expected , or } in object" : "expected , or ] in array");
+        }
+        break;
+      }
+      default:
+        return ptr;
+    }
+  }
+}
+
+//SAX模式下解析一个值，发出对应的事件，字符串解码到scratch里，不分配节点
+//object和array只发开始事件，返回左括号后面的位置，出错时返回NULL
+static const char* sax_value(const char* str, nodetype_t* type, parse_context_t* ctx) {
+  const CjsonSaxHandler* h = ctx->sax;
+  void* data = ctx->saxData;
+  const char* ptr = str;
+  switch (*ptr)
+  {
+    case '{':
+      *type = NodeType_OBJECT;
+      sax_result(ctx, !h->start_object || h->start_object(data));
+      return ptr + 1;
+    case '[':
+      *type = NodeType_ARRAY;
+      sax_result(ctx, !h->start_array || h->start_array(data));
+      return ptr + 1;
+    case 't':
+    case 'T':
+      *type = NodeType_TRUE;
+      if((ptr = match_literal(str, "true", &ctx->error)))
+        sax_result(ctx, !h->boolean || h->boolean(data, true));
+      return ptr;
+    case 'f':
+    case 'F':
+      *type = NodeType_FALSE;
+      if((ptr = match_literal(str, "false", &ctx->error)))
+        sax_result(ctx, !h->boolean || h->boolean(data, false));
+      return ptr;
+    case 'n':
+    case 'N':
+      *type = NodeType_NULL;
+      if((ptr = match_literal(str, "null", &ctx->error)))
+        sax_result(ctx, !h->null_value || h->null_value(data));
+      return ptr;
+    case '\"':
+      *type = NodeType_STRING;
+      if((ptr = parse_scratch(str, ctx)))
+        sax_result(ctx, !h->string || h->string(data, ctx->scratch, ctx->keyLen));
+      return ptr;
+    default: {
+      Cjson num; //parse_number只写数值和isInt
+      if(!*ptr || strchr("-+0123456789e", *ptr) == 0) {
+        return parse_fail(&ctx->error, ptr, *ptr ? "invalid value" : "unexpected end of input");
+      }
+      *type = NodeType_NUMBER;
+      ptr = parse_number(str, &num, ctx);
+      if(!ptr) {
+        return NULL;
+      }
+      if(num.isInt && h->integer) {
+        sax_result(ctx, h->integer(data, num.value.intNum));
+      } else if(h->number) {
+        sax_result(ctx, h->number(data, num.isInt ? (double)num.value.intNum : num.value.doubleNum));
+      }
+      return ptr;
+    }
+  }
+}
+
+//回调返回false时停止解析
+static void sax_result(parse_context_t* ctx, bool goOn) {
+  if(!goOn) {
+    ctx->stopped = true;
+  }
+}
+
+//流式解析时确认下一步要读的输入都在这块里，不完整时返回false等下一块
+//没有更多输入时不完整就是错误，记下错误返回false，只有数字可以在输入结尾处结束
+static bool parse_ready(const char** ptr, parse_context_t* ctx) {
+  const char* str = *ptr = skip_space_to(*ptr, ctx->end);
+  const char* tail;
+  bool ready = str < ctx->end;
+  if(ctx->state == PARSE_DONE || (ctx->state == PARSE_NEXT && !ctx->depth)) {
+    return true;
+  }
+  if(ready && ctx->state == PARSE_KEY) {
+    tail = ready_string(str, ctx);
+    ready = tail && skip_space_to(tail, ctx->end) < ctx->end; //冒号也要在这块里
+  } else if(ready && ctx->state == PARSE_VALUE) {
+    switch (*str)
+    {
+      case '{':
+      case '[':
+        break;
+      case 't':
+      case 'T':
+      case 'n':
+      case 'N':
+        ready = ctx->end - str >= 4;
+        break;
+      case 'f':
+      case 'F':
+        ready = ctx->end - str >= 5;
+        break;
+      case '\"':
+        ready = ready_string(str, ctx) != NULL;
+        break;
+      default: //数字后面出现别的字符才算结束
+        tail = str;
+        while(tail < ctx->end && *tail && strchr("+-.0123456789eE", *tail)) {
+          ++tail;
+        }
+        ready = tail < ctx->end || ctx->final;
+        break;
+    }
+  }
+  if(ready) {
+    ctx->checked = 0;
+    return true;
+  }
+  if(ctx->final) {
+    parse_fail(&ctx->error, str, "unexpected end of input");
+  }
+  return false;
+}
+
+//流式解析时找字符串的结束引号，找到返回引号后面的位置
+//没找到时记下已经找过的长度，下一块来了不用从头找，转义符在结尾时从转义符重新找
+static const char* ready_string(const char* str, parse_context_t* ctx) {
+  const char* ptr = str + (ctx->checked ? ctx->checked : 1);
+  for(;;) {
+    ptr = find_special(ptr, ctx->end);
+    if(ptr >= ctx->end) {
+      break;
+    }
+    if(*ptr == '\"') {
+      ctx->checked = ptr - str;
+      return ptr + 1;
+    }
+    if(*ptr++ == '\\') {
+      if(ptr >= ctx->end) {
+        --ptr;
+        break;
+      }
+      ++ptr;
+    }
+  }
+  ctx->checked = ptr - str;
+  return NULL;
+}
+
+//解析一个值并创建节点，key是解码好的键名，键名和字符串值和节点放在同一块内存里
+//object和array只创建节点，返回左括号后面的位置，成员由parse_run解析
+//出错时返回NULL，已经建好的节点仍然放在out里，由调用者释放
+static const char* parse_value(const char* str, Cjson** out, const char* key, size_t keyLen, parse_context_t* ctx) {
+  const char *ptr = str;
+  size_t extra = key && !ctx->keys && !ctx->insitu ? keyLen + 1 : 0,
+    strLen = 0;
+  *out = NULL;
+  if(!*ptr) {
+    return parse_fail(&ctx->error, ptr, "unexpected end of input");
+  }
+  if(*ptr == '\"' && !ctx->insitu) {
+    if(!scan_string(ptr, &strLen, &ctx->error)) {
+      return NULL;
+    }
+    extra += strLen + 1;
+  }
+  Cjson* item = parse_new_node(ctx, extra);
+  if(!item) {
+    return parse_fail(&ctx->error, str, "out of memory");
+  }
+  char* data = (char*)(item + 1);
+  *out = item;
+  if(key && ctx->keys) {
+    item->keyName = (char*)keytable_intern(ctx->keys, key, keyLen);
+    if(!item->keyName) {
+      return parse_fail(&ctx->error, str, "out of memory");
+    }
+    item->sharedKey = true;
+    ctx->keyRefs++;
+  } else if(key && ctx->insitu) { //键名已经在原缓冲区里解码好了
+    item->keyName = (char*)key;
+    item->borrowed = true;
+  } else if(key) {
+    item->keyName = data;
+    memcpy(data, key, keyLen + 1);
+    data += keyLen + 1;
+  }
+  switch (*ptr)
+  {
+    case '{':
+      set_nodeType(item, NodeType_OBJECT);
+      ++ptr;
+      break;
+    case '[':
+      set_nodeType(item, NodeType_ARRAY);
+      ++ptr;
+      break;
+    case 't':
+    case 'T':
+      set_nodeType(item, NodeType_TRUE);
+      ptr = match_literal(ptr, "true", &ctx->error);
+      break;
+    case 'f':
+    case 'F':
+      set_nodeType(item, NodeType_FALSE);
+      ptr = match_literal(ptr, "false", &ctx->error);
+      break;
+    case 'n':
+    case 'N':
+      set_nodeType(item, NodeType_NULL);
+      ptr = match_literal(ptr, "null", &ctx->error);
+      break;
+    case '\"':
+      set_nodeType(item, NodeType_STRING);
+      if(ctx->insitu) { //原地解码，解码后不会比原来长
+        item->value.complex = (char*)str + 1;
+        item->borrowed = true;
+      } else {
+        item->value.complex = data;
+      }
+      ptr = decode_string(str, item->value.complex, NULL, &ctx->error);
+      break;
+    default:
+      if(strchr("-+0123456789e", *ptr) == 0) {
+        return parse_fail(&ctx->error, ptr, "invalid value");
+      }
+      set_nodeType(item, NodeType_NUMBER);
+      ptr = parse_number(str, item, ctx);
+      break;
+  }
+  return ptr;
+}
+
+//计算字符串解码后长度的上界，返回结束引号后面的位置，出错时返回NULL
+static const char* scan_string(const char* str, size_t* len, parse_error_t* err) {
+  const char* ptr = str;
+  size_t res = 0;
+  if(*ptr++ != '\"') {
+    return parse_fail(err, str, "expected string");
+  }
+  for(;;) {
+    const char* run = find_special(ptr, NULL); //普通字符成段跳过
+    res += run - ptr;
+    ptr = run;
+    if(*ptr == '\"') {
+      break;
+    }
+    if(*ptr == '\0') {
+      return parse_fail(err, str, "string not closed");
+    }
+    if(*ptr++ == '\\') {
+      if(*ptr == '\0') {
+        return parse_fail(err, str, "string not closed");
+      }
+      if(*ptr++ != 'u') {
+        ++res;
+      } //\uxxxx按后面四个字符算，utf-8的长度不会超过它
+    } //控制字符不计入长度
+  }
+  *len = res;
+  return ptr + 1;
+}
+
+//解码字符串到out_ptr，加上\0，返回结束引号后面的位置，outLen不为NULL时带回解码后的长度
+//out_ptr可以是str + 1，这时原地解码；出错时返回NULL，out_ptr里是解码了一半的内容
+static const char* decode_string(const char* str, char* out_ptr, size_t* outLen, parse_error_t* err) {
+  const char* ptr = str;
+  char* out_start = out_ptr;
+  if(*ptr++ != '\"') {
+    return parse_fail(err, str, "expected string");
+  }
+  while(*ptr != '\"') {
+    if(*ptr != '\\') {
+      const char* run = find_special(ptr, NULL); //没有转义的部分整段复制
+      if(run != ptr) {
+        if(out_ptr != ptr) { //原地解码时前面没有转义就不用动
+          memmove(out_ptr, ptr, run - ptr);
+        }
+        out_ptr += run - ptr;
+        ptr = run;
+      } else if(*ptr) {
+        ++ptr; //控制字符丢掉
+      } else {
+        return parse_fail(err, str, "string not closed");
+      }
+    } else {
+      ++ptr;
+      switch(*ptr) {
+        case '/':
+          *out_ptr++ = '/';
+          break;
+        case '"': 
+          *out_ptr++ = '\"';
+          break;
+        case '\\':
+          *out_ptr++ = '\\';
+          break;
+        case 'b': 
+          *out_ptr++ = '\b';
+          break;
         case 'f':
           *out_ptr++ = '\f';
           break;
@@ -177,37 +1636,40 @@ static const char* parse_string(const char* str, Cjson* out) {
           break;
         case 'u': { //unicode
           ++ptr;
-          unsigned int w1 = compute_hex(&ptr), 
-            w2,
-            len = 4;
+          int w1 = compute_hex(&ptr), 
+            w2;
+          unsigned int len = 4;
           unsigned long int u = 0;
           
-          if(w1 < 0xD800 || w1 > 0xDFFF) {
+          if(w1 < 0) {
+            return parse_fail(err, ptr, "\\u needs four hex digits");
+          } else if(w1 < 0xD800 || w1 > 0xDFFF) {
             u = w1;
           } else if(w1 >= 0xD800 && w1 <= 0xDBFF) {
+            if(ptr[1] != '\\' || ptr[2] != 'u') {
+              return parse_fail(err, ptr + 1, "high surrogate needs a low surrogate");
+            }
+            ptr += 3;
             w2 = compute_hex(&ptr);
             if(w2 < 0xDC00 || w2 > 0xDFFF) {
-              printf("error w2 in parse_string method");
-              exit(1);
+              return parse_fail(err, ptr, "invalid low surrogate");
             }
             u = 0x10000 + (((w1 & 0x3ff) << 10) | (w2 & 0x3ff));
           } else {
-            printf("error w1 in parse_string method");
-            exit(1);
+            return parse_fail(err, ptr, "low surrogate without high surrogate");
           }
           
-          if(u >= 0 && u <= 0x00007F) {
+          if(u <= 0x00007F) {
             len = 1;
           } else if (u >= 0x000080 && u <= 0x0007FF) {
             len = 2;
-          } else if (u >= 0x000800 && u <= 0x00D7FF || 
-          u >= 0x00E000 && u <= 0x00FFFF) {
+          } else if ((u >= 0x000800 && u <= 0x00D7FF) || 
+          (u >= 0x00E000 && u <= 0x00FFFF)) {
             len = 3;
           } else if (u >= 0x010000 && u <= 0x10FFFF) {
             len = 4;
           } else {
-            printf("u is not in the BMP, error in parse_string method");
-            exit(1);
+            return parse_fail(err, ptr, "invalid code point");
           }
 
           switch (len)
@@ -221,239 +1683,2990 @@ static const char* parse_string(const char* str, Cjson* out) {
               int lenTmp = len - 1;
               out_ptr += len;
               while(lenTmp-- != 0) {
-                *(--out_ptr) = u & 0x3f | 0x80;
+                *(--out_ptr) = (u & 0x3f) | 0x80;
                 u = u >> 6;
               }
-              *(--out_ptr) = u & 0x3f | ((len == 4) ? 0xf0 : len == 3 ? 0xe0 : 0xc0);  
+              *(--out_ptr) = (u & 0x3f) | ((len == 4) ? 0xf0 : len == 3 ? 0xe0 : 0xc0);  
               out_ptr += len;
               break;
             }
-            default: 
-              printf("len is wrong, error in parse_string method");
-              exit(1);
           }
           break;
         }
+        case '\0':
+          return parse_fail(err, str, "string not closed");
         default: 
           *out_ptr++ = *ptr;
       }
       ++ptr;
     }
   }
-  *ptr++;
-  *out_ptr = '\0';
-  return ptr;
+  ptr++;
+  *out_ptr = '\0';
+  if(outLen)
+    *outLen = out_ptr - out_start;
+  return ptr;
+}
+
+//计算前导代理和后尾代理，不是四位十六进制时返回-1
+static int compute_hex(const char** ptr) {
+  int res = 0x00,
+   lowChar;
+  for(int i = 4; i > 0; i--) {
+    if(**ptr >= '0' && **ptr <= '9') {
+      res += **ptr - '0';
+    } else{
+      lowChar = tolower(**ptr);
+      if(lowChar <= 'f' && lowChar >= 'a') {
+        res += lowChar + 10 - 'a';
+      } else {
+        return -1; //ptr停在不是十六进制的字符上
+      }
+    }
+    if(i != 1){
+      res *= 16;
+      ++(*ptr);
+    }
+  }
+  return res;
+}
+
+//检查true，false，null，大小写都可以，word是小写的，返回字面量后面的位置
+static const char* match_literal(const char* str, const char* word, parse_error_t* err) {
+  const char* ptr = str;
+  for(; *word; ++word, ++ptr) {
+    if(tolower((unsigned char)*ptr) != *word) {
+      return parse_fail(err, str, "invalid literal");
+    }
+  }
+  return ptr;
+}
+
+//设置nodeType
+static void set_nodeType(Cjson* item, nodetype_t nodeType) {
+  if(item && nodeType) {
+    item->nodeType = nodeType;
+  }
+}
+
+//解析数字，整数直接存到64位的intNum，小数先走快速路径
+static const char* parse_number(const char* str, Cjson* out, parse_context_t* ctx) {
+  parse_error_t* err = &ctx->error;
+  static const double exact_pow10[] = {1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8,
+    1e9, 1e10, 1e11, 1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22}; //double能精确表示的10的幂
+  const char* ptr = str;
+  bool negative = false, isInt = true;
+  uint64_t mantissa = 0;
+  int digits = 0, //有效数字个数
+    dropped = 0, //超过19位以后丢掉的整数位数
+    exponent = 0;
+  if(*ptr == '-' || *ptr == '+') {
+    negative = *ptr++ == '-';
+  }
+  const char* digitStart = ptr;
+  while(*ptr >= '0' && *ptr <= '9') {
+    if(digits < 19) {
+      mantissa = mantissa * 10 + (*ptr - '0');
+      if(mantissa || digits) { //前导0不算有效数字
+        ++digits;
+      }
+    } else {
+      ++dropped;
+    }
+    ++ptr;
+  }
+  if(*ptr == '.') {
+    isInt = false;
+    ++ptr;
+    while(*ptr >= '0' && *ptr <= '9') {
+      if(digits < 19) {
+        mantissa = mantissa * 10 + (*ptr - '0');
+        if(mantissa || digits) {
+          ++digits;
+        }
+        --exponent;
+      }
+      ++ptr;
+    }
+  }
+  if(ptr == digitStart || (ptr == digitStart + 1 && *digitStart == '.')) {
+    return parse_fail(err, str, "invalid number");
+  }
+  if(*ptr == 'e' || *ptr == 'E') {
+    bool expNegative = false;
+    int expValue = 0;
+    isInt = false;
+    ++ptr;
+    if(*ptr == '-' || *ptr == '+') {
+      expNegative = *ptr++ == '-';
+    }
+    if(*ptr < '0' || *ptr > '9') {
+      return parse_fail(err, ptr, "exponent needs digits");
+    }
+    while(*ptr >= '0' && *ptr <= '9') {
+      if(expValue < 100000)
+        expValue = expValue * 10 + (*ptr - '0');
+      ++ptr;
+    }
+    exponent += expNegative ? -expValue : expValue;
+  }
+
+  if(isInt && !dropped && mantissa <= (uint64_t)INT64_MAX + negative) {
+    out->value.intNum = negative ? (int64_t)(0 - mantissa) : (int64_t)mantissa;
+    out->isInt = true;
+    return ptr;
+  }
+  out->isInt = false;
+  exponent += dropped;
+  //快速路径：尾数不超过2^53，10的幂也能精确表示时，一次乘除就是正确舍入的结果
+  if(!dropped && digits <= 19 && mantissa <= ((uint64_t)1 << 53)) {
+    double num = (double)mantissa;
+    if(exponent < 0 && exponent >= -22) {
+      out->value.doubleNum = negative ? -(num / exact_pow10[-exponent]) : num / exact_pow10[-exponent];
+      return ptr;
+    }
+    if(exponent >= 0 && exponent <= 22 + 15) {
+      if(exponent > 22) { //先把多出来的幂乘到尾数上，尾数还精确的话仍然可以走快速路径
+        num *= exact_pow10[exponent - 22];
+        exponent = 22;
+      }
+      if(num <= 9007199254740992.0) {
+        num *= exact_pow10[exponent];
+        out->value.doubleNum = negative ? -num : num;
+        return ptr;
+      }
+    }
+  }
+  if(!parse_number_slow(str, ptr, &out->value.doubleNum, ctx->mem)) {
+    return parse_fail(err, str, "out of memory");
+  }
+  return ptr;
+}
+
+//慢速路径，用strtod保证正确舍入；strtod跟locale有关，所以把小数点换成当前locale的小数点，没有内存时返回false
+static bool parse_number_slow(const char* str, const char* end, double* out, CjsonContext* mem) {
+  char stackBuf[64];
+  size_t len = end - str;
+  char* buf = len < sizeof(stackBuf) ? stackBuf : (char*)mem->malloc_fn(len + 1);
+  char point = localeconv()->decimal_point[0];
+  if(!buf) {
+    return false;
+  }
+  for(size_t i = 0; i < len; i++) {
+    buf[i] = str[i] == '.' ? point : str[i];
+  }
+  buf[len] = '\0';
+  *out = strtod(buf, NULL);
+  if(buf != stackBuf) {
+    mem->free_fn(buf);
+  }
+  return true;
+}
+
+//跳过空白，大多数情况下只有一两个空白，先逐字节看一下再成段跳过
+static const char* skip_space(const char* str) {
+  if(!str || (unsigned char)*str > 32 || !*str) {
+    return str;
+  }
+  if((unsigned char)str[1] > 32 || !str[1]) {
+    return str + 1;
+  }
+  return skip_blank(str + 1, NULL);
+}
+
+//跳过空白，最多跳到end，end和后面的字节都不读
+static const char* skip_space_to(const char* str, const char* end) {
+  if(str >= end || (unsigned char)*str > 32 || !*str) {
+    return str;
+  }
+  return skip_blank(str + 1, end);
+}
+
+//解析时跳过空白，流式解析和按长度解析时输入后面不一定有\0，不能越过end
+static const char* parse_skip(const char* str, const parse_context_t* ctx) {
+  return ctx->end ? skip_space_to(str, ctx->end) : skip_space(str);
+}
+
+//object的键名索引，开放寻址的哈希表，槽位数是2的幂
+typedef struct {
+  uint32_t hash;
+  Cjson* item;
+} cjson_index_slot_t;
+
+//键名索引和元素数组共用的头，记下建的时候第一个和最后一个成员；容器的child变了，最后一个成员后面接了节点，
+//或者add_next在中间插入时清掉了最后一个成员的indexed，它就过期了；只看这一个容器，不影响别的容器
+//查找的线程可能还在用过期的那个，所以查找时不释放，重建后挂在新的上面，见cache_publish
+struct _cjson_cache {
+  Cjson* first;
+  Cjson* last;
+  cjson_cache_t* retired; //被它换下来的过期的那个，删除容器或者下一次重建时释放
+  void (*free_fn) (void *); //为NULL时在arena里
+};
+
+struct _cjson_index {
+  cjson_cache_t head;
+  uint32_t count; //成员个数
+  uint32_t mask; //槽位数减1
+  cjson_index_slot_t slots[1];
+};
+
+//键名的哈希，FNV-1a
+static uint32_t hash_key(const char* key) {
+  uint32_t hash = 2166136261u;
+  while(*key) {
+    hash = (hash ^ (unsigned char)*key++) * 16777619u;
+  }
+  return hash;
+}
+
+//给object建索引，重复的键名只记第一个，和逐个查找的结果一致；stale是要换下来的过期索引
+//索引先在旁边建好再原子地挂到object上，多个线程同时查找同一棵只读的树时只留下一个
+static cjson_index_t* build_index(Cjson* obj, CjsonArena* arena, CjsonContext* mem, cjson_cache_t* stale) {
+  uint32_t count = 0, capacity = 16;
+  for(Cjson* cur = obj->child; cur; cur = cur->next)
+    count++;
+  while(capacity < count * 2)
+    capacity *= 2;
+  size_t size = sizeof(cjson_index_t) + (capacity - 1) * sizeof(cjson_index_slot_t);
+  cjson_index_t* index = (cjson_index_t*)(arena ? cjson_arena_alloc(arena, size) : mem->malloc_fn(size));
+  if(!index) {
+    return NULL; //没有内存就不建索引，退回逐个查找
+  }
+  memset(index, 0, size);
+  index->head.first = obj->child;
+  index->head.free_fn = arena ? NULL : mem->free_fn; //索引自己记住怎么释放
+  index->count = count;
+  index->mask = capacity - 1;
+  for(Cjson* cur = obj->child; cur; cur = cur->next) {
+    __atomic_store_n(&cur->indexed, true, __ATOMIC_RELAXED);
+    index->head.last = cur;
+    if(!cur->keyName)
+      continue;
+    uint32_t hash = cur->sharedKey ? key_header(cur->keyName)->hash : hash_key(cur->keyName),
+      pos = hash & index->mask;
+    while(index->slots[pos].item &&
+      !(index->slots[pos].hash == hash && strcmp(index->slots[pos].item->keyName, cur->keyName) == 0)) {
+      pos = (pos + 1) & index->mask;
+    }
+    if(!index->slots[pos].item) {
+      index->slots[pos].hash = hash;
+      index->slots[pos].item = cur;
+    }
+  }
+  return (cjson_index_t*)cache_publish((cjson_cache_t**)&obj->value.index, &index->head, stale);
+}
+
+//元素列表还是不是建的时候的样子
+static bool list_unchanged(const Cjson* container, const cjson_cache_t* cache) {
+  return container->child == cache->first && (!cache->last ||
+    (!cache->last->next && __atomic_load_n(&cache->last->indexed, __ATOMIC_RELAXED)));
+}
+
+//容器上挂着的索引或者元素数组，过期时返回NULL，过期的那个放在stale里，重建时交给cache_publish换下来
+static cjson_cache_t* cache_load(cjson_cache_t** slot, const Cjson* container, cjson_cache_t** stale) {
+  cjson_cache_t* cache = __atomic_load_n(slot, __ATOMIC_ACQUIRE);
+  *stale = NULL;
+  if(cache && !list_unchanged(container, cache)) {
+    *stale = cache;
+    return NULL;
+  }
+  return cache;
+}
+
+//把建好的cache原子地挂到slot上换下stale，别的线程先挂好了时释放自己的，返回挂着的那个
+//换下来的stale别的查找线程可能还在读，先挂在新的上面；stale自己换下来的更早的那个，
+//只有在让stale过期的那次修改之前的查找会用到，修改和查找不能同时进行，现在已经没有线程在用，可以释放
+static cjson_cache_t* cache_publish(cjson_cache_t** slot, cjson_cache_t* cache, cjson_cache_t* stale) {
+  cjson_cache_t* expected = stale;
+  cache->retired = stale;
+  if(!__atomic_compare_exchange_n(slot, &expected, cache, false, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE)) {
+    if(cache->free_fn) { //别的线程先建好了，用它的
+      cache->free_fn(cache);
+    }
+    return expected;
+  }
+  if(stale && stale->retired) {
+    cache_free(stale->retired);
+    stale->retired = NULL;
+  }
+  return cache;
+}
+
+//释放索引或者元素数组，连同挂在它上面换下来的
+static void cache_free(cjson_cache_t* cache) {
+  while(cache) {
+    cjson_cache_t* retired = cache->retired;
+    if(cache->free_fn) {
+      cache->free_fn(cache);
+    }
+    cache = retired;
+  }
+}
+
+//按键名查找object的成员，成员多时第一次查找建索引，找不到返回NULL
+Cjson* cjson_get(const Cjson* obj, const char* key) {
+  return object_lookup(obj, key, false, &default_context);
+}
+
+//用上下文创建的树，第一次查找时索引用同一个上下文的allocator建
+Cjson* cjson_get_ctx(CjsonContext* mem, const Cjson* obj, const char* key) {
+  return object_lookup(obj, key, false, mem);
+}
+
+//key是cjson_keytable_intern返回的键名，同一张表里的键名只比较指针
+Cjson* cjson_get_interned(const Cjson* obj, const char* key) {
+  return object_lookup(obj, key, true, &default_context);
+}
+
+//比较成员的键名，同一张键名表里相同的键名一定是同一个指针
+static bool key_equal(const Cjson* item, const char* key, bool interned) {
+  if(item->keyName == key) {
+    return true;
+  }
+  if(interned && item->sharedKey && key_header(item->keyName)->table == key_header(key)->table) {
+    return false;
+  }
+  return item->keyName && item->keyName[0] == key[0] && strcmp(item->keyName, key) == 0;
+}
+
+static Cjson* object_lookup(const Cjson* obj, const char* key, bool interned, CjsonContext* mem) {
+  return object_find(obj, key, NULL, interned, mem);
+}
+
+//查找object的成员，hash是key的哈希，为NULL时用到索引才算，编译好的查询路径不用每次都算
+//成员多时用mem的allocator建索引，mem为NULL时不建，只用已经有的索引
+static Cjson* object_find(const Cjson* obj, const char* key, const uint32_t* hash, bool interned, CjsonContext* mem) {
+  if(!obj || !key || obj->nodeType != NodeType_OBJECT) {
+    return NULL;
+  }
+  Cjson* item = (Cjson*)obj;
+  cjson_cache_t* stale;
+  cjson_index_t* index = (cjson_index_t*)cache_load((cjson_cache_t**)&item->value.index, item, &stale);
+  if(!index && !item->inArena && mem) { //没建过或者object被add_next改过，建新的
+    uint32_t count = 0;
+    for(Cjson* cur = item->child; cur && count < CJSON_INDEX_MIN_MEMBERS; cur = cur->next)
+      count++;
+    if(count >= CJSON_INDEX_MIN_MEMBERS)
+      index = build_index(item, NULL, mem, stale);
+  }
+  if(!index) { //成员少或者arena里的object，逐个比较
+    for(Cjson* cur = item->child; cur; cur = cur->next) {
+      if(key_equal(cur, key, interned))
+        return cur;
+    }
+    return NULL;
+  }
+  uint32_t keyHash = hash ? *hash : interned ? key_header(key)->hash : hash_key(key),
+    pos = keyHash & index->mask;
+  while(index->slots[pos].item) {
+    if(index->slots[pos].hash == keyHash && key_equal(index->slots[pos].item, key, interned))
+      return index->slots[pos].item;
+    pos = (pos + 1) & index->mask;
+  }
+  return NULL;
+}
+
+//array的元素数组，第i个元素是items[i]，过期和换下来的处理和键名索引一样，见cjson_cache_t
+struct _cjson_vector {
+  cjson_cache_t head;
+  size_t count; //元素个数
+  Cjson* items[1];
+};
+
+//给array建元素数组，没有内存时返回NULL，退回逐个走；stale是要换下来的过期元素数组
+//和build_index一样在旁边建好再原子地挂上去，同时查找的线程只留下一个
+static cjson_vector_t* build_vector(Cjson* arr, CjsonArena* arena, CjsonContext* mem, cjson_cache_t* stale) {
+  size_t count = 0;
+  for(Cjson* cur = arr->child; cur; cur = cur->next)
+    count++;
+  size_t size = sizeof(cjson_vector_t) + (count ? count - 1 : 0) * sizeof(Cjson*);
+  cjson_vector_t* vector = (cjson_vector_t*)(arena ? cjson_arena_alloc(arena, size) : mem->malloc_fn(size));
+  if(!vector) {
+    return NULL;
+  }
+  memset(&vector->head, 0, sizeof(vector->head));
+  vector->head.first = arr->child;
+  vector->head.free_fn = arena ? NULL : mem->free_fn;
+  vector->count = count;
+  count = 0;
+  for(Cjson* cur = arr->child; cur; cur = cur->next) {
+    vector->items[count++] = cur;
+    __atomic_store_n(&cur->indexed, true, __ATOMIC_RELAXED);
+    vector->head.last = cur;
+  }
+  return (cjson_vector_t*)cache_publish((cjson_cache_t**)&arr->value.vector, &vector->head, stale);
+}
+
+//array当前有效的元素数组，修改过时重建，元素少或者在arena里时返回NULL，由调用者逐个走
+//用mem的allocator建，mem为NULL时不建，只用已经有的元素数组
+static cjson_vector_t* array_vector(const Cjson* arr, CjsonContext* mem) {
+  Cjson* item = (Cjson*)arr;
+  cjson_cache_t* stale;
+  cjson_vector_t* vector = (cjson_vector_t*)cache_load((cjson_cache_t**)&item->value.vector, item, &stale);
+  if(!vector && !item->inArena && mem) { //没建过或者array被add_next改过，建新的
+    size_t count = 0;
+    for(Cjson* cur = item->child; cur && count < CJSON_VECTOR_MIN_ITEMS; cur = cur->next)
+      count++;
+    if(count >= CJSON_VECTOR_MIN_ITEMS)
+      vector = build_vector(item, NULL, mem, stale);
+  }
+  return vector;
+}
+
+//array的元素个数，不是array时返回0；有元素数组时直接用，不为了数个数去建
+size_t cjson_array_size(const Cjson* arr) {
+  if(!arr || arr->nodeType != NodeType_ARRAY) {
+    return 0;
+  }
+  cjson_vector_t* vector = array_vector(arr, NULL);
+  if(vector) {
+    return vector->count;
+  }
+  size_t count = 0;
+  for(Cjson* cur = arr->child; cur; cur = cur->next)
+    count++;
+  return count;
+}
+
+//取array的第i个元素，越界或者不是array时返回NULL；从后往前取也不需要prev
+Cjson* cjson_array_get(const Cjson* arr, size_t i) {
+  return cjson_array_get_ctx(&default_context, arr, i);
+}
+
+//用上下文创建的树，元素数组用同一个上下文的allocator建
+Cjson* cjson_array_get_ctx(CjsonContext* mem, const Cjson* arr, size_t i) {
+  return array_at(arr, i, mem);
+}
+
+//取array的第i个元素，元素多时用mem的allocator建元素数组，mem为NULL时不建，只用已经有的
+static Cjson* array_at(const Cjson* arr, size_t i, CjsonContext* mem) {
+  if(!arr || arr->nodeType != NodeType_ARRAY) {
+    return NULL;
+  }
+  cjson_vector_t* vector = array_vector(arr, mem);
+  if(vector) {
+    return i < vector->count ? vector->items[i] : NULL;
+  }
+  Cjson* cur = arr->child;
+  for(; cur && i; cur = cur->next, i--)
+    ;
+  return cur;
+}
+
+//添加下一个节点，cur在建过索引的object或者建过元素数组的array里时让它们失效，cur或next为NULL时返回NULL
+Cjson* add_next(Cjson* cur, Cjson* next) {
+  if(!cur || !next) {
+    return NULL;
+  }
+  if(__atomic_load_n(&cur->indexed, __ATOMIC_RELAXED)) {
+    Cjson* tail = cur;
+    while(tail->next) //在中间插入，清掉最后一个成员的标记让这个容器的索引或者元素数组过期；接在最后面时它们自己能看出来
+      tail = tail->next;
+    if(tail != cur) {
+      __atomic_store_n(&tail->indexed, false, __ATOMIC_RELAXED);
+    }
+  }
+  return link_next(cur, next);
+}
+
+//把next链到cur后面，解析时新建的节点还没有索引，不用通知
+static Cjson* link_next(Cjson* cur, Cjson* next) {
+  next->next = cur->next;
+#ifndef CJSON_SINGLY_LINKED
+  if(cur->next) {
+    cur->next->prev = next;
+  }
+  next->prev = cur;
+#endif
+  cur->next = next;
+  return cur;
+}
+
+ //删除Cjson对象和它后面的兄弟节点，arena里的节点由cjson_arena_free统一释放
+ //不用递归：把子节点链表接到当前节点后面，整棵树就变成一条链，逐个释放
+Cjson* deleteCjson(Cjson* out) {
+  return deleteCjson_ctx(&default_context, out);
+}
+
+//删除用上下文创建的树，mem要和创建时的一样
+Cjson* deleteCjson_ctx(CjsonContext* mem, Cjson* out) {
+  while(out) {
+    if(out->child) {
+      Cjson* last = out->child;
+      while(last->next)
+        last = last->next;
+      last->next = out->next;
+      out->next = out->child;
+      out->child = NULL;
+    }
+    Cjson* next = out->next;
+    free_node(out, mem);
+    out = next;
+  }
+  return NULL;
+}
+
+//释放单个节点和它自己的键名，字符串，索引
+static void free_node(Cjson* out, CjsonContext* mem) {
+  if(out->nodeType == NodeType_OBJECT) {
+    cache_free((cjson_cache_t*)out->value.index);
+  } else if(out->nodeType == NodeType_ARRAY) {
+    cache_free((cjson_cache_t*)out->value.vector);
+  }
+  if(out->sharedKey) { //键名表里的键名，放掉对表的引用
+    keytable_release(key_header(out->keyName)->table, 1);
+  }
+  if(!out->inArena) {
+    if(!out->inlineData && !out->borrowed) { //键名和字符串跟节点在同一块内存里或者在调用者的缓冲区里时不用单独释放
+      if(out->keyName && !out->sharedKey) 
+       mem->free_fn(out->keyName);
+      if(out->nodeType != NodeType_NUMBER && out->nodeType != NodeType_OBJECT &&
+        out->nodeType != NodeType_ARRAY && out->value.complex) {
+        mem->free_fn(out->value.complex);
+      }
+    }
+    mem->free_fn(out);
+  }
+}
+
+//懒解析：第一遍只记下结构字符的位置，访问到的值才解析成节点
+struct _cjson_lazy {
+  CjsonContext* mem; //索引和物化出来的节点用的allocator
+  const char* json;
+  uint32_t* pos; //object和array的括号，冒号，逗号和字符串开头引号在json里的位置，最后是结尾\0的位置
+  uint32_t* match; //左括号对应的右括号在pos里的下标，其他位置不用
+  uint32_t count; //pos里的个数，不算结尾
+};
+
+//前缀异或，结果的第i位是0到i位的异或，引号之间的位是1
+static uint64_t prefix_xor(uint64_t bits) {
+  bits ^= bits << 1;
+  bits ^= bits << 2;
+  bits ^= bits << 4;
+  bits ^= bits << 8;
+  bits ^= bits << 16;
+  bits ^= bits << 32;
+  return bits;
+}
+
+//找出被转义的字符，连续的反斜杠只有奇数个时后面的字符才被转义，prevEscaped带上一块结尾的状态
+static uint64_t lazy_escaped(uint64_t backslash, uint64_t* prevEscaped) {
+  const uint64_t evenBits = 0x5555555555555555ULL;
+  backslash &= ~*prevEscaped; //被上一块转义的反斜杠不算
+  uint64_t followsEscape = backslash << 1 | *prevEscaped,
+    oddStarts = backslash & ~evenBits & ~followsEscape, //从奇数位开始的反斜杠串
+    evenStarts;
+  *prevEscaped = __builtin_add_overflow(oddStarts, backslash, &evenStarts);
+  uint64_t invert = evenStarts << 1; //从奇数位开始的串结束后的位置
+  return (evenBits ^ invert) & followsEscape;
+}
+
+//第一遍扫描，按64字节一块记下字符串外的结构字符，出错时返回false
+static bool lazy_stage1(CjsonLazy* doc, size_t len, parse_error_t* err) {
+  uint32_t cap = (uint32_t)(len / 4) + 64;
+  uint64_t prevEscaped = 0, prevInString = 0;
+  char tail[64];
+  doc->pos = (uint32_t*)doc->mem->malloc_fn(cap * sizeof(uint32_t));
+  if(!doc->pos) {
+    parse_fail(err, NULL, "out of memory");
+    return false;
+  }
+  doc->count = 0;
+  for(size_t offset = 0; offset < len; offset += 64) {
+    const char* block = doc->json + offset;
+    lazy_block_t m;
+    if(len - offset < 64) { //最后不满一块时复制出来，后面补空格
+      memset(tail, ' ', sizeof(tail));
+      memcpy(tail, block, len - offset);
+      block = tail;
+    }
+    lazy_masks(block, &m);
+    uint64_t quote = m.quote & ~lazy_escaped(m.backslash, &prevEscaped),
+      inString = prefix_xor(quote) ^ prevInString; //开头引号算在字符串里，结尾引号不算
+    prevInString = (uint64_t)((int64_t)inString >> 63);
+    uint64_t bits = (m.structural & ~inString) | (quote & inString);
+    if(doc->count + 64 + 1 > cap) {
+      cap *= 2;
+      uint32_t* pos = (uint32_t*)doc->mem->malloc_fn(cap * sizeof(uint32_t));
+      if(!pos) {
+        parse_fail(err, doc->json + offset, "out of memory");
+        return false;
+      }
+      memcpy(pos, doc->pos, doc->count * sizeof(uint32_t));
+      doc->mem->free_fn(doc->pos);
+      doc->pos = pos;
+    }
+    while(bits) {
+      doc->pos[doc->count++] = (uint32_t)(offset + __builtin_ctzll(bits));
+      bits &= bits - 1;
+    }
+  }
+  doc->pos[doc->count] = (uint32_t)len;
+  if(prevInString) {
+    parse_fail(err, doc->json + len, "string not closed");
+    return false;
+  }
+  return true;
+}
+
+//配对括号，左括号记下对应右括号的下标，跳过不访问的子树时直接跳到右括号，出错时返回false
+static bool lazy_match(CjsonLazy* doc, parse_error_t* err) {
+  uint32_t localStack[64], *stack = localStack,
+    cap = sizeof(localStack) / sizeof(localStack[0]), depth = 0;
+  doc->match = (uint32_t*)doc->mem->malloc_fn((doc->count + 1) * sizeof(uint32_t));
+  if(!doc->match) {
+    parse_fail(err, NULL, "out of memory");
+    return false;
+  }
+  for(uint32_t i = 0; i < doc->count && !err->reason; i++) {
+    char c = doc->json[doc->pos[i]];
+    if(c == '{' || c == '[') {
+      if(depth == cap) {
+        uint32_t* bigger = (uint32_t*)doc->mem->malloc_fn(cap * 2 * sizeof(uint32_t));
+        if(!bigger) {
+          parse_fail(err, doc->json + doc->pos[i], "out of memory");
+          break;
+        }
+        memcpy(bigger, stack, depth * sizeof(uint32_t));
+        if(stack != localStack) {
+          doc->mem->free_fn(stack);
+        }
+        stack = bigger;
+        cap *= 2;
+      }
+      stack[depth++] = i;
+    } else if(c == '}' || c == ']') {
+      if(!depth || doc->json[doc->pos[stack[depth - 1]]] != (c == '}' ? '{' : '[')) {
+        parse_fail(err, doc->json + doc->pos[i], "brackets do not match");
+        break;
+      }
+      doc->match[stack[--depth]] = i;
+    }
+  }
+  if(depth) {
+    parse_fail(err, doc->json + doc->pos[stack[depth - 1]], "brackets not closed");
+  }
+  if(stack != localStack) {
+    doc->mem->free_fn(stack);
+  }
+  return !err->reason;
+}
+
+//建结构索引，str要比索引活得久，不复制；出错时返回NULL，原因和位置用cjson_last_error取
+CjsonLazy* cjson_lazy_parse(const char* str) {
+  return cjson_lazy_parse_ctx(&default_context, str);
+}
+
+//用上下文的allocator建结构索引，cjson_lazy_materialize物化出来的节点也用它，要用deleteCjson_ctx释放
+CjsonLazy* cjson_lazy_parse_ctx(CjsonContext* mem, const char* str) {
+  parse_context_t ctx; //只用来记错误和算位置
+  size_t len = strlen(str);
+  CjsonLazy* doc = len < UINT32_MAX ? (CjsonLazy*)mem->malloc_fn(sizeof(CjsonLazy)) : NULL;
+  if(!doc) {
+    parse_report(len < UINT32_MAX ? "out of memory" : "json is too long");
+    return NULL;
+  }
+  parse_init(&ctx, mem);
+  ctx.start = str;
+  doc->mem = mem;
+  doc->json = str;
+  doc->pos = doc->match = NULL;
+  bool ok = lazy_stage1(doc, len, &ctx.error) && lazy_match(doc, &ctx.error);
+  parse_release(&ctx); //parse_init可能拿走了mem留着的临时空间，还回去
+  if(!ok) {
+    parse_abort(&ctx, &last_error);
+    cjson_lazy_free(doc);
+    return NULL;
+  }
+  memset(&last_error, 0, sizeof(last_error));
+  return doc;
+}
+
+//释放结构索引，物化出来的节点归调用者
+void cjson_lazy_free(CjsonLazy* doc) {
+  if(doc->pos)
+    doc->mem->free_fn(doc->pos);
+  if(doc->match)
+    doc->mem->free_fn(doc->match);
+  doc->mem->free_fn(doc);
+}
+
+//构造指向index位置后面那个值的句柄，index是值前面的左括号，逗号或者冒号
+static CjsonLazyValue lazy_value_after(const CjsonLazy* doc, uint32_t index) {
+  CjsonLazyValue v;
+  v.doc = doc;
+  v.ptr = skip_space(doc->json + doc->pos[index] + 1);
+  v.index = index + 1;
+  return v;
+}
+
+//跳过一个值，返回值后面的逗号或者右括号的下标
+static uint32_t lazy_skip(CjsonLazyValue v) {
+  switch(*v.ptr) {
+    case '{':
+    case '[':
+      return v.doc->match[v.index] + 1;
+    case '\"':
+      return v.index + 1;
+    default: //数字和字面量不在索引里
+      return v.index;
+  }
+}
+
+//比较索引里的键名和key，键名里有转义时解码以后再比，解码不了或者没有内存时算不相等
+static bool lazy_key_equal(const CjsonLazy* doc, const char* raw, const char* key) {
+  const char* ptr = raw + 1, *cur = key;
+  while(*ptr != '\"') {
+    if(*ptr == '\\') {
+      parse_error_t err = {NULL, NULL};
+      size_t len;
+      if(!scan_string(raw, &len, &err)) {
+        return false;
+      }
+      char* decoded = (char*)doc->mem->malloc_fn(len + 1);
+      if(!decoded) {
+        return false;
+      }
+      bool res = decode_string(raw, decoded, NULL, &err) && strcmp(decoded, key) == 0;
+      doc->mem->free_fn(decoded);
+      return res;
+    }
+    if(*ptr++ != *cur++) {
+      return false;
+    }
+  }
+  return *cur == '\0';
+}
+
+//根节点
+CjsonLazyValue cjson_lazy_root(const CjsonLazy* doc) {
+  CjsonLazyValue v;
+  v.doc = doc;
+  v.ptr = skip_space(doc->json);
+  v.index = 0;
+  if(!*v.ptr) {
+    v.ptr = NULL;
+  }
+  return v;
+}
+
+//值的类型，看第一个字符就知道，不存在的值返回NOTYPE
+nodetype_t cjson_lazy_type(CjsonLazyValue v) {
+  if(!v.ptr) {
+    return NOTYPE;
+  }
+  switch(*v.ptr) {
+    case '{':
+      return NodeType_OBJECT;
+    case '[':
+      return NodeType_ARRAY;
+    case '\"':
+      return NodeType_STRING;
+    case 't':
+    case 'T':
+      return NodeType_TRUE;
+    case 'f':
+    case 'F':
+      return NodeType_FALSE;
+    case 'n':
+    case 'N':
+      return NodeType_NULL;
+    default:
+      return NodeType_NUMBER;
+  }
+}
+
+//按键名找object的成员，不匹配的成员整个跳过，找不到或者成员没有键名时返回的值ptr为NULL
+CjsonLazyValue cjson_lazy_get(CjsonLazyValue obj, const char* key) {
+  CjsonLazyValue res;
+  memset(&res, 0, sizeof(res));
+  if(!obj.ptr || *obj.ptr != '{') {
+    return res;
+  }
+  const CjsonLazy* doc = obj.doc;
+  uint32_t index = obj.index; //左括号或者逗号
+  for(;;) {
+    const char* name = doc->json + doc->pos[index + 1];
+    if(*name == '}' && index == obj.index) {
+      return res; //空object
+    }
+    if(*name != '\"' || doc->json[doc->pos[index + 2]] != ':') {
+      return res;
+    }
+    CjsonLazyValue member = lazy_value_after(doc, index + 2);
+    if(lazy_key_equal(obj.doc, name, key)) {
+      return member;
+    }
+    index = lazy_skip(member);
+    if(doc->json[doc->pos[index]] != ',') {
+      return res;
+    }
+  }
+}
+
+//取array的第i个元素，前面的元素整个跳过，越界时返回的值ptr为NULL
+CjsonLazyValue cjson_lazy_at(CjsonLazyValue arr, size_t i) {
+  CjsonLazyValue res;
+  memset(&res, 0, sizeof(res));
+  if(!arr.ptr || *arr.ptr != '[') {
+    return res;
+  }
+  const CjsonLazy* doc = arr.doc;
+  uint32_t index = arr.index;
+  if(doc->json[doc->pos[index + 1]] == ']' && skip_space(arr.ptr + 1) == doc->json + doc->pos[index + 1]) {
+    return res; //空数组
+  }
+  for(;;) {
+    CjsonLazyValue item = lazy_value_after(doc, index);
+    if(!i--) {
+      return item;
+    }
+    index = lazy_skip(item);
+    if(doc->json[doc->pos[index]] != ',') {
+      return res;
+    }
+  }
+}
+
+//把值解析成节点，只解析这个值和它的子树，返回的树用deleteCjson释放
+Cjson* cjson_lazy_materialize(CjsonLazyValue v) {
+  if(!v.ptr) {
+    return NULL;
+  }
+  return cjson_parse_ctx(v.doc->mem, v.ptr);
+}
+
+//tape：整棵树压成一块连续的内存，结构是一串64位的字，字符串放在后面的字符串区
+//每个字高8位是类型字符，低56位是参数：
+//  [ {  低32位是对应的右括号后面那个字的下标，跳过整个容器不用看里面，32到55位是成员数
+//  ] }  对应的左括号的下标
+//  "    字符串区里的偏移，那里是4字节的长度，字符串和结尾的\0；object的键名也这样存，后面紧跟着值
+//  l d  整数和小数，值放在下一个字里
+//  t f n
+//tape建好后不再修改，多个线程可以同时读，不用加锁
+struct _cjson_tape {
+  uint64_t* words;
+  size_t count; //字的个数
+  char* strings; //字符串区，和words在同一块内存里
+  size_t stringLen;
+  CjsonContext* mem; //释放tape用的allocator
+};
+
+#define TAPE_TYPE(word) ((char)((word) >> 56))
+#define TAPE_PAYLOAD(word) ((word) & 0xffffffffffffffULL)
+#define TAPE_WORD(type, payload) ((uint64_t)(unsigned char)(type) << 56 | (payload))
+#define TAPE_COUNT_MAX 0xffffffULL //左括号里能存的最大成员数，更多时要数一遍
+
+//建tape时的一层容器
+typedef struct {
+  size_t open; //左括号的下标
+  size_t count; //已经有的成员数
+  const Cjson* node; //从树建tape时是这个容器的节点
+} tape_frame_t;
+
+//建tape用的缓冲区，字和字符串区直接写在最后交出去的那块内存里，放不下时换一块更大的
+typedef struct {
+  CjsonTape* tape; //字在tape后面，字符串区在字的容量后面
+  size_t count, cap; //字的个数和容量
+  size_t stringLen, stringCap; //字符串区的长度和容量，容量不算结尾的\0
+  tape_frame_t* stack;
+  size_t depth, stackCap;
+  bool sizing; //只数出字和字符串区的大小，不写入
+  bool failed; //没有内存或者tape太大，后面的操作都不做
+  CjsonContext* mem; //tape和栈用的allocator
+} tape_builder_t;
+
+//buf里已经有used个单位，保证能放下need个，不够时按两倍扩容
+static bool tape_grow(CjsonContext* mem, void** buf, size_t* cap, size_t used, size_t need, size_t unit) {
+  if(need <= *cap) {
+    return true;
+  }
+  size_t newCap = *cap ? *cap : 64;
+  while(newCap < need) {
+    newCap *= 2;
+  }
+  void* tmp = mem->malloc_fn(newCap * unit);
+  if(!tmp) {
+    return false;
+  }
+  if(*buf) {
+    memcpy(tmp, *buf, used * unit);
+    mem->free_fn(*buf);
+  }
+  *buf = tmp;
+  *cap = newCap;
+  return true;
+}
+
+//换一块能放下words个字和strings字节字符串的内存，已经写入的内容复制过去
+static bool tape_reserve(tape_builder_t* b, size_t words, size_t strings) {
+  size_t wordBytes = words * sizeof(uint64_t);
+  CjsonTape* tape = (CjsonTape*)b->mem->malloc_fn(sizeof(CjsonTape) + wordBytes + strings + 1);
+  if(!tape) {
+    b->failed = true;
+    return false;
+  }
+  tape->words = (uint64_t*)(tape + 1);
+  tape->strings = (char*)tape->words + wordBytes;
+  if(b->tape) {
+    memcpy(tape->words, b->tape->words, b->count * sizeof(uint64_t));
+    memcpy(tape->strings, b->tape->strings, b->stringLen);
+    b->mem->free_fn(b->tape);
+  }
+  b->tape = tape;
+  b->cap = words;
+  b->stringCap = strings;
+  return true;
+}
+
+//加一个字
+static bool tape_push(tape_builder_t* b, uint64_t word) {
+  if(b->sizing) {
+    b->count++;
+    return true;
+  }
+  if(b->failed || (b->count == b->cap && !tape_reserve(b, b->cap * 2 + 16, b->stringCap))) {
+    return false;
+  }
+  b->tape->words[b->count++] = word;
+  return true;
+}
+
+//在容器里时成员数加一，键名不算
+static void tape_member(tape_builder_t* b) {
+  if(b->depth) {
+    b->stack[b->depth - 1].count++;
+  }
+}
+
+//加true，false，null
+static bool tape_scalar(tape_builder_t* b, char type) {
+  tape_member(b);
+  return tape_push(b, TAPE_WORD(type, 0));
+}
+
+//加数字，值放在类型后面的字里
+static bool tape_number(tape_builder_t* b, bool isInt, int64_t intNum, double doubleNum) {
+  uint64_t bits;
+  if(isInt) {
+    bits = (uint64_t)intNum;
+  } else {
+    memcpy(&bits, &doubleNum, sizeof(bits));
+  }
+  tape_member(b);
+  return tape_push(b, TAPE_WORD(isInt ? 'l' : 'd', 0)) && tape_push(b, bits);
+}
+
+//加字符串或者键名，字符串区里存长度，内容和\0
+static bool tape_string(tape_builder_t* b, const char* str, size_t len, bool isKey) {
+  uint32_t len32 = (uint32_t)len;
+  if(b->failed || len > UINT32_MAX) {
+    b->failed = true;
+    return false;
+  }
+  size_t offset = b->stringLen;
+  if(!b->sizing) {
+    if(offset + len + 5 > b->stringCap && !tape_reserve(b, b->cap, (offset + len + 5) * 2)) {
+      return false;
+    }
+    char* dst = b->tape->strings + offset;
+    memcpy(dst, &len32, 4);
+    memcpy(dst + 4, str, len);
+    dst[4 + len] = '\0';
+  }
+  b->stringLen += len + 5;
+  if(!isKey) {
+    tape_member(b);
+  }
+  return tape_push(b, TAPE_WORD('"', offset));
+}
+
+//加左括号，参数等右括号加进来时再填
+static bool tape_open(tape_builder_t* b, char type, const Cjson* node) {
+  tape_member(b);
+  if(b->failed || !tape_grow(b->mem, (void**)&b->stack, &b->stackCap, b->depth, b->depth + 1, sizeof(tape_frame_t))) {
+    b->failed = true;
+    return false;
+  }
+  tape_frame_t* frame = &b->stack[b->depth++];
+  frame->open = b->count;
+  frame->count = 0;
+  frame->node = node;
+  return tape_push(b, TAPE_WORD(type, 0));
+}
+
+static void tape_walk(tape_builder_t* b, const Cjson* root); //按树的顺序把节点加到tape里
+
+//加右括号，回填左括号里的成员数和跳过容器的下标
+static bool tape_close(tape_builder_t* b) {
+  if(b->failed || !b->depth) {
+    b->failed = true;
+    return false;
+  }
+  tape_frame_t* frame = &b->stack[--b->depth];
+  if(b->count + 1 > UINT32_MAX) {
+    b->failed = true;
+    return false;
+  }
+  if(b->sizing) {
+    b->count++;
+    return true;
+  }
+  char type = TAPE_TYPE(b->tape->words[frame->open]);
+  if(!tape_push(b, TAPE_WORD(type == '{' ? '}' : ']', frame->open))) {
+    return false;
+  }
+  uint64_t count = frame->count < TAPE_COUNT_MAX ? frame->count : TAPE_COUNT_MAX;
+  b->tape->words[frame->open] = TAPE_WORD(type, count << 32 | b->count);
+  return true;
+}
+
+//释放建tape用的缓冲区，交出去的tape已经不在b里
+static void tape_release(tape_builder_t* b) {
+  if(b->tape) {
+    b->mem->free_fn(b->tape);
+  }
+  if(b->stack) {
+    b->mem->free_fn(b->stack);
+  }
+}
+
+//建好的tape交出去，释放栈；失败时返回NULL
+static CjsonTape* tape_finish(tape_builder_t* b) {
+  CjsonTape* tape = NULL;
+  if(!b->failed && b->count && !b->depth) {
+    tape = b->tape;
+    b->tape = NULL;
+    tape->count = b->count;
+    tape->stringLen = b->stringLen;
+    tape->mem = b->mem;
+    tape->strings[b->stringLen] = '\0';
+  }
+  tape_release(b);
+  return tape;
+}
+
+//把树压成tape，树不会被修改，之后可以删掉；没有内存时返回NULL
+//先走一遍只数大小，第二遍直接写到正好大小的tape里，不用扩容和复制
+CjsonTape* cjson_tape_freeze(const Cjson* root) {
+  return cjson_tape_freeze_ctx(&default_context, root);
+}
+
+//用上下文的allocator建tape，cjson_tape_free时也用它释放
+CjsonTape* cjson_tape_freeze_ctx(CjsonContext* mem, const Cjson* root) {
+  tape_builder_t b;
+  memset(&b, 0, sizeof(b));
+  b.mem = mem;
+  if(!root) {
+    return NULL;
+  }
+  b.sizing = true;
+  tape_walk(&b, root);
+  b.sizing = false;
+  if(!b.failed && tape_reserve(&b, b.count, b.stringLen)) {
+    b.count = b.stringLen = 0;
+    tape_walk(&b, root);
+  }
+  return tape_finish(&b);
+}
+
+//按树的顺序把节点加到tape里，用显式的栈代替递归
+static void tape_walk(tape_builder_t* b, const Cjson* root) {
+  const Cjson* cur = root;
+  for(;;) {
+    if(b->depth && b->stack[b->depth - 1].node->nodeType == NodeType_OBJECT) { //object的成员先加键名
+      const char* key = cur->keyName ? cur->keyName : "";
+      tape_string(b, key, strlen(key), true);
+    }
+    switch(cur->nodeType) {
+      case NodeType_NULL:
+        tape_scalar(b, 'n');
+        break;
+      case NodeType_TRUE:
+        tape_scalar(b, 't');
+        break;
+      case NodeType_FALSE:
+        tape_scalar(b, 'f');
+        break;
+      case NodeType_STRING: {
+        const char* str = cur->value.complex ? cur->value.complex : "";
+        tape_string(b, str, strlen(str), false);
+        break;
+      }
+      case NodeType_NUMBER:
+        tape_number(b, cur->isInt, cur->value.intNum, cur->value.doubleNum);
+        break;
+      case NodeType_ARRAY:
+      case NodeType_OBJECT:
+        if(tape_open(b, cur->nodeType == NodeType_OBJECT ? '{' : '[', cur) && cur->child) {
+          cur = cur->child;
+          continue;
+        }
+        tape_close(b);
+        break;
+      default:
+        b->failed = true;
+        break;
+    }
+    while(!b->failed && b->depth && !cur->next) { //最后一个成员，容器结束
+      cur = b->stack[b->depth - 1].node;
+      tape_close(b);
+    }
+    if(b->failed || !b->depth) {
+      return;
+    }
+    cur = cur->next;
+  }
+}
+
+//直接解析成tape用的SAX回调，不建节点
+static bool tape_on_null(void* userdata) {
+  return tape_scalar((tape_builder_t*)userdata, 'n');
+}
+
+static bool tape_on_boolean(void* userdata, bool value) {
+  return tape_scalar((tape_builder_t*)userdata, value ? 't' : 'f');
+}
+
+static bool tape_on_integer(void* userdata, int64_t value) {
+  return tape_number((tape_builder_t*)userdata, true, value, 0);
+}
+
+static bool tape_on_number(void* userdata, double value) {
+  return tape_number((tape_builder_t*)userdata, false, 0, value);
+}
+
+static bool tape_on_string(void* userdata, const char* str, size_t len) {
+  return tape_string((tape_builder_t*)userdata, str, len, false);
+}
+
+static bool tape_on_key(void* userdata, const char* key, size_t len) {
+  return tape_string((tape_builder_t*)userdata, key, len, true);
+}
+
+static bool tape_on_object(void* userdata) {
+  return tape_open((tape_builder_t*)userdata, '{', NULL);
+}
+
+static bool tape_on_array(void* userdata) {
+  return tape_open((tape_builder_t*)userdata, '[', NULL);
+}
+
+static bool tape_on_end(void* userdata) {
+  return tape_close((tape_builder_t*)userdata);
+}
+
+//解析json直接建tape，不经过节点；出错时返回NULL，原因和位置用cjson_last_error取
+CjsonTape* cjson_tape_parse(const char* str) {
+  return cjson_tape_parse_ctx(&default_context, str);
+}
+
+//用上下文的allocator直接解析成tape
+CjsonTape* cjson_tape_parse_ctx(CjsonContext* mem, const char* str) {
+  static const CjsonSaxHandler handler = {tape_on_null, tape_on_boolean, tape_on_integer, tape_on_number,
+    tape_on_string, tape_on_key, tape_on_object, tape_on_end, tape_on_array, tape_on_end};
+  tape_builder_t b;
+  memset(&b, 0, sizeof(b));
+  b.mem = mem;
+  size_t len = str ? strlen(str) : 0;
+  //按输入长度先留好空间，一般的json不用换内存，没写到的页不会真正占用内存
+  if(!tape_reserve(&b, len / 3 + 16, len + len / 4 + 16)) {
+    parse_report("out of memory");
+    return NULL;
+  }
+  if(!cjson_parse_sax_ctx(mem, str, &handler, &b)) {
+    if(b.failed) {
+      parse_report("out of memory");
+    }
+    tape_release(&b);
+    return NULL;
+  }
+  CjsonTape* tape = tape_finish(&b);
+  if(!tape) {
+    parse_report("out of memory");
+  }
+  return tape;
+}
+
+//释放tape，从它取出的字符串都不能再用
+void cjson_tape_free(CjsonTape* tape) {
+  if(tape) {
+    tape->mem->free_fn(tape);
+  }
+}
+
+//不存在的值
+static CjsonTapeValue tape_none(void) {
+  CjsonTapeValue v;
+  v.tape = NULL;
+  v.index = 0;
+  v.key = 0;
+  return v;
+}
+
+//index位置的值，是右括号时值不存在；inObject时index是键名，值在它后面
+static CjsonTapeValue tape_value_at(const CjsonTape* tape, size_t index, bool inObject) {
+  char type = TAPE_TYPE(tape->words[index]);
+  if(type == ']' || type == '}') {
+    return tape_none();
+  }
+  CjsonTapeValue v;
+  v.tape = tape;
+  v.key = inObject ? (uint32_t)index : 0;
+  v.index = (uint32_t)(inObject ? index + 1 : index);
+  return v;
+}
+
+//值后面那个字的下标，容器直接跳到右括号后面
+static size_t tape_after(const CjsonTape* tape, size_t index) {
+  uint64_t word = tape->words[index];
+  switch(TAPE_TYPE(word)) {
+    case '[':
+    case '{':
+      return (uint32_t)word;
+    case 'l':
+    case 'd':
+      return index + 2;
+    default:
+      return index + 1;
+  }
+}
+
+//字符串区里偏移offset的字符串
+static const char* tape_string_at(const CjsonTape* tape, uint64_t word, size_t* len) {
+  uint32_t len32;
+  const char* str = tape->strings + TAPE_PAYLOAD(word);
+  memcpy(&len32, str, 4);
+  if(len) {
+    *len = len32;
+  }
+  return str + 4;
+}
+
+//根节点，tape为NULL时返回不存在的值
+CjsonTapeValue cjson_tape_root(const CjsonTape* tape) {
+  return tape ? tape_value_at(tape, 0, false) : tape_none();
+}
+
+//值的类型，不存在的值返回NOTYPE
+nodetype_t cjson_tape_type(CjsonTapeValue v) {
+  if(!v.tape) {
+    return NOTYPE;
+  }
+  switch(TAPE_TYPE(v.tape->words[v.index])) {
+    case '[':
+      return NodeType_ARRAY;
+    case '{':
+      return NodeType_OBJECT;
+    case '"':
+      return NodeType_STRING;
+    case 'l':
+    case 'd':
+      return NodeType_NUMBER;
+    case 't':
+      return NodeType_TRUE;
+    case 'f':
+      return NodeType_FALSE;
+    case 'n':
+      return NodeType_NULL;
+    default:
+      return NOTYPE;
+  }
+}
+
+//array，object的成员数，一般直接从左括号里取，成员太多时才数一遍；其他值返回0
+size_t cjson_tape_size(CjsonTapeValue v) {
+  nodetype_t type = cjson_tape_type(v);
+  if(type != NodeType_ARRAY && type != NodeType_OBJECT) {
+    return 0;
+  }
+  size_t count = (size_t)(TAPE_PAYLOAD(v.tape->words[v.index]) >> 32);
+  if(count < TAPE_COUNT_MAX) {
+    return count;
+  }
+  count = 0;
+  for(CjsonTapeValue item = cjson_tape_first(v); item.tape; item = cjson_tape_next(item)) {
+    count++;
+  }
+  return count;
+}
+
+//容器的第一个成员，空容器或者不是容器时返回不存在的值
+CjsonTapeValue cjson_tape_first(CjsonTapeValue v) {
+  nodetype_t type = cjson_tape_type(v);
+  if(type != NodeType_ARRAY && type != NodeType_OBJECT) {
+    return tape_none();
+  }
+  return tape_value_at(v.tape, v.index + 1, type == NodeType_OBJECT);
+}
+
+//同一个容器里的下一个成员，跳过v的子树只要O(1)，没有了返回不存在的值
+CjsonTapeValue cjson_tape_next(CjsonTapeValue v) {
+  if(!v.tape || v.index == 0) {
+    return tape_none();
+  }
+  return tape_value_at(v.tape, tape_after(v.tape, v.index), v.key != 0);
+}
+
+//object成员的键名，len可以为NULL，不是object成员时返回NULL
+const char* cjson_tape_key(CjsonTapeValue v, size_t* len) {
+  if(!v.tape || !v.key) {
+    return NULL;
+  }
+  return tape_string_at(v.tape, v.tape->words[v.key], len);
+}
+
+//按键名找object的成员，其他成员的子树整个跳过，找不到时返回不存在的值
+CjsonTapeValue cjson_tape_get(CjsonTapeValue obj, const char* key) {
+  if(cjson_tape_type(obj) != NodeType_OBJECT || !key) {
+    return tape_none();
+  }
+  size_t keyLen = strlen(key), len = 0;
+  for(CjsonTapeValue item = cjson_tape_first(obj); item.tape; item = cjson_tape_next(item)) {
+    const char* name = cjson_tape_key(item, &len);
+    if(len == keyLen && memcmp(name, key, len) == 0) {
+      return item;
+    }
+  }
+  return tape_none();
+}
+
+//取array的第i个元素，前面的元素整个跳过，越界时返回不存在的值
+CjsonTapeValue cjson_tape_at(CjsonTapeValue arr, size_t i) {
+  if(cjson_tape_type(arr) != NodeType_ARRAY) {
+    return tape_none();
+  }
+  CjsonTapeValue item = cjson_tape_first(arr);
+  while(item.tape && i--) {
+    item = cjson_tape_next(item);
+  }
+  return item;
+}
+
+//字符串的内容，以\0结尾，len是包括中间的\0在内的长度，可以为NULL；不是字符串时返回NULL
+const char* cjson_tape_string(CjsonTapeValue v, size_t* len) {
+  if(cjson_tape_type(v) != NodeType_STRING) {
+    return NULL;
+  }
+  return tape_string_at(v.tape, v.tape->words[v.index], len);
+}
+
+//数字的值，整数转成double，不是数字时返回0
+double cjson_tape_number(CjsonTapeValue v) {
+  if(cjson_tape_type(v) != NodeType_NUMBER) {
+    return 0;
+  }
+  uint64_t bits = v.tape->words[v.index + 1];
+  if(TAPE_TYPE(v.tape->words[v.index]) == 'l') {
+    return (double)(int64_t)bits;
+  }
+  double num;
+  memcpy(&num, &bits, sizeof(num));
+  return num;
+}
+
+//是整数时把值写到out里返回true，小数和其他值返回false
+bool cjson_tape_int(CjsonTapeValue v, int64_t* out) {
+  if(!v.tape || TAPE_TYPE(v.tape->words[v.index]) != 'l') {
+    return false;
+  }
+  if(out) {
+    *out = (int64_t)v.tape->words[v.index + 1];
+  }
+  return true;
+}
+
+//二进制编码：保存和重新读入树时不用转义字符串，也不用格式化和解析数字
+//每个值先是一个类型字节：
+//  0x00 null  0x01 false  0x02 true
+//  0x03 整数，后面是zigzag编码的varint
+//  0x04 小数，后面是8字节小端的double
+//  0x05 字符串，后面是varint长度和内容，没有\0
+//  0x06 array  0x07 object，后面是4字节小端的内容长度，4字节小端的成员数，然后是成员
+//       object的每个成员先是varint长度的键名，再是值
+//  0x80到0xff 0到127的整数，值在类型字节里
+//容器带着内容的字节数，读的时候不用解码就能跳过整个子树
+#define BINARY_NULL 0x00
+#define BINARY_FALSE 0x01
+#define BINARY_TRUE 0x02
+#define BINARY_INT 0x03
+#define BINARY_DOUBLE 0x04
+#define BINARY_STRING 0x05
+#define BINARY_ARRAY 0x06
+#define BINARY_OBJECT 0x07
+#define BINARY_SMALL_INT 0x80
+
+//编码时的一层容器
+typedef struct {
+  const Cjson* node;
+  size_t header; //内容长度在输出里的位置，容器结束时回填
+  uint32_t count;
+} binary_frame_t;
+
+//解码时的一层容器，和解析栈一一对应
+typedef struct {
+  const unsigned char* end; //容器内容的结尾
+  uint32_t count; //声明的成员数
+} binary_end_t;
+
+//输出varint，每字节7位，低位在前，最多10个字节
+static bool binary_varint(printbuffer_t* p, uint64_t value) {
+  unsigned char* res = (unsigned char*)ensure(p, 10);
+  if(!res) {
+    return false;
+  }
+  size_t n = 0;
+  while(value >= 0x80) {
+    res[n++] = (unsigned char)(value | 0x80);
+    value >>= 7;
+  }
+  res[n++] = (unsigned char)value;
+  p->offset += n;
+  return true;
+}
+
+//在pos的位置写4字节小端的整数
+static void binary_put32(char* pos, uint32_t value) {
+  for(int i = 0; i < 4; i++) {
+    pos[i] = (char)(value >> (8 * i));
+  }
+}
+
+//输出类型字节和后面固定长度的内容，len为0时只有类型字节
+static bool binary_tag(printbuffer_t* p, unsigned char tag, const void* data, size_t len) {
+  char* res = ensure(p, len + 1);
+  if(!res) {
+    return false;
+  }
+  *res = (char)tag;
+  if(len) {
+    memcpy(res + 1, data, len);
+  }
+  p->offset += len + 1;
+  return true;
+}
+
+//输出带varint长度的字符串，键名和字符串值共用
+static bool binary_string(printbuffer_t* p, const char* str) {
+  size_t len = strlen(str);
+  return binary_varint(p, len) && print_bytes(p, str, len);
+}
+
+//编码一个数字，小的非负整数直接放在类型字节里
+static bool binary_number(printbuffer_t* p, const Cjson* item) {
+  unsigned char bytes[8];
+  uint64_t bits;
+  if(item->isInt) {
+    int64_t num = item->value.intNum;
+    if(num >= 0 && num < 0x80) {
+      return binary_tag(p, (unsigned char)(BINARY_SMALL_INT | num), NULL, 0);
+    }
+    bits = (uint64_t)num;
+    return binary_tag(p, BINARY_INT, NULL, 0) &&
+      binary_varint(p, (bits << 1) ^ (uint64_t)(num >> 63)); //zigzag，绝对值小的负数也短
+  }
+  memcpy(&bits, &item->value.doubleNum, sizeof(bits));
+  for(int i = 0; i < 8; i++) {
+    bytes[i] = (unsigned char)(bits >> (8 * i));
+  }
+  return binary_tag(p, BINARY_DOUBLE, bytes, 8);
+}
+
+//把树编码成二进制，len带回长度，返回的内存用cjson_binary_free释放；没有内存或者树不合法时返回NULL
+void* cjson_binary_encode(const Cjson* root, size_t* len) {
+  return cjson_binary_encode_ctx(&default_context, root, len);
+}
+
+//用上下文的allocator编码，返回的内存用mem->free_fn释放
+void* cjson_binary_encode_ctx(CjsonContext* mem, const Cjson* root, size_t* len) {
+  binary_frame_t localStack[32], *stack = localStack; //嵌套不深时不用分配
+  size_t depth = 0, stackCap = sizeof(localStack) / sizeof(localStack[0]);
+  printbuffer_t p;
+  print_setup(&p, mem, NULL);
+  p.length = 256;
+  p.buffer = (char*)mem->malloc_fn(p.length);
+  if(!p.buffer || !root) {
+    if(p.buffer) {
+      mem->free_fn(p.buffer);
+    }
+    return NULL;
+  }
+  const Cjson* cur = root;
+  bool res = true;
+  for(;;) {
+    if(depth && stack[depth - 1].node->nodeType == NodeType_OBJECT) { //object的成员先输出键名
+      if(!cur->keyName || !binary_string(&p, cur->keyName)) {
+        res = false;
+        break;
+      }
+    }
+    if(depth) {
+      stack[depth - 1].count++;
+    }
+    switch(cur->nodeType) {
+      case NodeType_NULL:
+        res = binary_tag(&p, BINARY_NULL, NULL, 0);
+        break;
+      case NodeType_FALSE:
+        res = binary_tag(&p, BINARY_FALSE, NULL, 0);
+        break;
+      case NodeType_TRUE:
+        res = binary_tag(&p, BINARY_TRUE, NULL, 0);
+        break;
+      case NodeType_STRING:
+        res = binary_tag(&p, BINARY_STRING, NULL, 0) && binary_string(&p, cur->value.complex ? cur->value.complex : "");
+        break;
+      case NodeType_NUMBER:
+        res = binary_number(&p, cur);
+        break;
+      case NodeType_ARRAY:
+      case NodeType_OBJECT: {
+        static const char header[8] = {0};
+        if(depth == stackCap) {
+          binary_frame_t* tmp = (binary_frame_t*)mem->malloc_fn(stackCap * 2 * sizeof(binary_frame_t));
+          if(!tmp) {
+            res = false;
+            break;
+          }
+          memcpy(tmp, stack, depth * sizeof(binary_frame_t));
+          if(stack != localStack)
+            mem->free_fn(stack);
+          stack = tmp;
+          stackCap *= 2;
+        }
+        res = binary_tag(&p, cur->nodeType == NodeType_OBJECT ? BINARY_OBJECT : BINARY_ARRAY, header, 8);
+        stack[depth].node = cur;
+        stack[depth].header = p.offset - 8;
+        stack[depth].count = 0;
+        depth++;
+        if(res && cur->child) { //进入容器，先输出第一个成员
+          cur = cur->child;
+          continue;
+        }
+        cur = NULL; //空容器，下面直接结束
+        break;
+      }
+      default:
+        res = false;
+        break;
+    }
+    while(res && depth && (!cur || !cur->next)) { //最后一个成员，容器结束，回填长度和成员数
+      binary_frame_t* top = &stack[--depth];
+      size_t body = p.offset - top->header - 8;
+      if(body > UINT32_MAX) {
+        res = false;
+        break;
+      }
+      binary_put32(p.buffer + top->header, (uint32_t)body);
+      binary_put32(p.buffer + top->header + 4, top->count);
+      cur = top->node;
+    }
+    if(!res || !depth) {
+      break;
+    }
+    cur = cur->next;
+  }
+  if(stack != localStack) {
+    mem->free_fn(stack);
+  }
+  if(!res) {
+    mem->free_fn(p.buffer);
+    return NULL;
+  }
+  if(len) {
+    *len = p.offset;
+  }
+  return p.buffer;
+}
+
+//释放cjson_binary_encode返回的内存，它是默认allocator分配的，new_hook换过allocator时不能直接用free
+void cjson_binary_free(void* data) {
+  if(data) {
+    cjson_free(data);
+  }
+}
+
+//读varint，超过end或者超过64位时返回false
+static bool binary_read_varint(const unsigned char** ptr, const unsigned char* end, uint64_t* value) {
+  uint64_t res = 0;
+  for(int shift = 0; shift < 64 && *ptr < end; shift += 7) {
+    unsigned char byte = *(*ptr)++;
+    res |= (uint64_t)(byte & 0x7f) << shift;
+    if(!(byte & 0x80)) {
+      *value = res;
+      return true;
+    }
+  }
+  return false;
+}
+
+//读4字节小端的整数
+static uint32_t binary_get32(const unsigned char* pos) {
+  return (uint32_t)pos[0] | (uint32_t)pos[1] << 8 | (uint32_t)pos[2] << 16 | (uint32_t)pos[3] << 24;
+}
+
+//解码二进制，出错时返回NULL，cjson_last_error里的offset是出错的字节位置
+//内容必须正好是一个值，长度和成员数都要和声明的一致
+Cjson* cjson_binary_decode(const void* data, size_t len) {
+  return cjson_binary_decode_ctx(&default_context, data, len);
+}
+
+//用上下文的allocator解码，树用deleteCjson_ctx释放
+Cjson* cjson_binary_decode_ctx(CjsonContext* mem, const void* data, size_t len) {
+  binary_end_t localEnds[32], *ends = localEnds; //和解析栈一起增长
+  size_t endCap = sizeof(localEnds) / sizeof(localEnds[0]);
+  const unsigned char* start = (const unsigned char*)data;
+  const unsigned char* ptr = start;
+  const unsigned char* end = start + len;
+  parse_context_t ctx;
+  parse_init(&ctx, mem);
+  if(!data) {
+    parse_fail(&ctx.error, NULL, "no input");
+  }
+  while(!ctx.error.reason) {
+    const unsigned char* limit = ctx.depth ? ends[ctx.depth - 1].end : end;
+    const unsigned char* pos = ptr;
+    const char* key = NULL;
+    const char* str = NULL;
+    uint64_t keyLen = 0, strLen = 0, num = 0;
+    uint32_t body = 0, count = 0;
+    unsigned char bytes[8];
+    if(ctx.depth && ctx.stack[ctx.depth - 1].isObject) { //object的成员先是键名
+      if(!binary_read_varint(&ptr, limit, &keyLen) || keyLen > (uint64_t)(limit - ptr)) {
+        parse_fail(&ctx.error, (const char*)pos, "truncated key");
+        break;
+      }
+      key = (const char*)ptr;
+      ptr += keyLen;
+      pos = ptr;
+    }
+    if(ptr >= limit) {
+      parse_fail(&ctx.error, (const char*)pos, "unexpected end of input");
+      break;
+    }
+    unsigned char tag = *ptr++;
+    if(tag == BINARY_STRING) { //先读完长度再分配节点，字符串和键名跟节点放在一起
+      if(!binary_read_varint(&ptr, limit, &strLen) || strLen > (uint64_t)(limit - ptr)) {
+        parse_fail(&ctx.error, (const char*)pos, "truncated string");
+        break;
+      }
+      str = (const char*)ptr;
+      ptr += strLen;
+    } else if(tag == BINARY_INT) {
+      if(!binary_read_varint(&ptr, limit, &num)) {
+        parse_fail(&ctx.error, (const char*)pos, "truncated number");
+        break;
+      }
+    } else if(tag == BINARY_DOUBLE || tag == BINARY_ARRAY || tag == BINARY_OBJECT) {
+      if(limit - ptr < 8) {
+        parse_fail(&ctx.error, (const char*)pos, "truncated value");
+        break;
+      }
+      memcpy(bytes, ptr, 8);
+      ptr += 8;
+      body = binary_get32(bytes);
+      count = binary_get32(bytes + 4);
+      if(tag != BINARY_DOUBLE && body > (uint64_t)(limit - ptr)) {
+        parse_fail(&ctx.error, (const char*)pos, "container longer than its parent");
+        break;
+      }
+    } else if(tag > BINARY_TRUE && tag < BINARY_SMALL_INT) {
+      parse_fail(&ctx.error, (const char*)pos, "invalid value");
+      break;
+    }
+    Cjson* item = parse_new_node(&ctx, (key ? keyLen + 1 : 0) + (str ? strLen + 1 : 0));
+    if(!item) {
+      parse_fail(&ctx.error, (const char*)pos, "out of memory");
+      break;
+    }
+    char* dst = (char*)(item + 1);
+    if(key) {
+      item->keyName = dst;
+      memcpy(dst, key, keyLen);
+      dst[keyLen] = '\0';
+      dst += keyLen + 1;
+    }
+    parse_attach(&ctx, item);
+    switch(tag) {
+      case BINARY_NULL:
+        set_nodeType(item, NodeType_NULL);
+        break;
+      case BINARY_FALSE:
+        set_nodeType(item, NodeType_FALSE);
+        break;
+      case BINARY_TRUE:
+        set_nodeType(item, NodeType_TRUE);
+        break;
+      case BINARY_STRING:
+        set_nodeType(item, NodeType_STRING);
+        item->value.complex = dst;
+        memcpy(dst, str, strLen);
+        dst[strLen] = '\0';
+        break;
+      case BINARY_INT:
+        set_nodeType(item, NodeType_NUMBER);
+        item->isInt = true;
+        item->value.intNum = (int64_t)(num >> 1) ^ -(int64_t)(num & 1);
+        break;
+      case BINARY_DOUBLE: {
+        uint64_t bits = (uint64_t)body | (uint64_t)count << 32;
+        set_nodeType(item, NodeType_NUMBER);
+        memcpy(&item->value.doubleNum, &bits, sizeof(bits));
+        break;
+      }
+      case BINARY_ARRAY:
+      case BINARY_OBJECT:
+        set_nodeType(item, tag == BINARY_OBJECT ? NodeType_OBJECT : NodeType_ARRAY);
+        if(!parse_push(&ctx, item, tag == BINARY_OBJECT, (const char*)pos)) {
+          break;
+        }
+        if(ctx.depth > endCap) {
+          binary_end_t* tmp = (binary_end_t*)mem->malloc_fn(endCap * 2 * sizeof(binary_end_t));
+          if(!tmp) {
+            parse_fail(&ctx.error, (const char*)pos, "out of memory");
+            break;
+          }
+          memcpy(tmp, ends, endCap * sizeof(binary_end_t));
+          if(ends != localEnds)
+            mem->free_fn(ends);
+          ends = tmp;
+          endCap *= 2;
+        }
+        ends[ctx.depth - 1].end = ptr + body;
+        ends[ctx.depth - 1].count = count;
+        break;
+      default:
+        set_nodeType(item, NodeType_NUMBER);
+        item->isInt = true;
+        item->value.intNum = tag & 0x7f;
+        break;
+    }
+    while(!ctx.error.reason && ctx.depth && ptr == ends[ctx.depth - 1].end) { //内容读完，容器结束
+      if(ctx.stack[ctx.depth - 1].count != ends[ctx.depth - 1].count) {
+        parse_fail(&ctx.error, (const char*)ptr, "member count does not match");
+        break;
+      }
+      parse_pop(&ctx);
+    }
+    if(!ctx.depth) {
+      break;
+    }
+  }
+  if(!ctx.error.reason && ptr != end) {
+    parse_fail(&ctx.error, (const char*)ptr, "trailing bytes after value");
+  }
+  if(ends != localEnds) {
+    mem->free_fn(ends);
+  }
+  parse_release(&ctx);
+  if(ctx.error.reason) {
+    last_error.offset = ctx.error.pos ? (size_t)((const unsigned char*)ctx.error.pos - start) : 0;
+    last_error.line = 1; //二进制没有行，列就是字节位置
+    last_error.column = last_error.offset + 1;
+    last_error.reason = ctx.error.reason;
+    deleteCjson_ctx(mem, ctx.root);
+    return NULL;
+  }
+  memset(&last_error, 0, sizeof(last_error));
+  return ctx.root;
+}
+
+//查询路径：编译一次，之后在很多棵树上反复用，每次查找不分配内存
+//支持JSON Pointer："/Image/Thumbnail/Url"，~0是~，~1是/，是数字的段在array上按下标取
+//和点号路径："Image.IDs[0]"，"[*].City"，"*"和"[*]"匹配所有成员，键名里的.和[前面加\转义
+//查询步骤
+typedef enum {
+  QUERY_KEY, //按键名取object的成员，JSON Pointer里是数字时在array上按下标取
+  QUERY_INDEX, //按下标取array的元素
+  QUERY_ANY //容器的所有成员
+} query_step_type_t;
+
+//查询路径里的一步，键名的长度和哈希编译时就算好
+typedef struct {
+  query_step_type_t type;
+  const char* key; //以\0结尾，放在query后面的键名区里
+  size_t keyLen;
+  uint32_t hash; //和object索引用的同一个哈希
+  size_t index;
+  bool hasIndex; //QUERY_KEY的键名是数字
+} query_step_t;
+
+//编译好的查询，步骤和键名和query在同一块内存里
+struct _cjson_query {
+  size_t count; //步数，0表示根节点本身
+  query_step_t* steps;
+  char* keys;
+  CjsonContext* mem; //释放查询用的allocator
+};
+
+//读十进制的下标，溢出时返回false
+static bool query_index(const char** ptr, size_t* index) {
+  const char* cur = *ptr;
+  size_t res = 0;
+  if(!isdigit((unsigned char)*cur)) {
+    return false;
+  }
+  while(isdigit((unsigned char)*cur)) {
+    if(res > (SIZE_MAX - 9) / 10) {
+      return false;
+    }
+    res = res * 10 + (*cur++ - '0');
+  }
+  *ptr = cur;
+  *index = res;
+  return true;
+}
+
+//扫一遍路径，q->steps为NULL时只数步数和键名区的长度，否则把步骤填进去；路径不合法时返回false
+static bool query_scan(const char* path, CjsonQuery* q, size_t* keyBytes) {
+  const char* ptr = path;
+  bool pointer = *ptr == '/';
+  size_t count = 0, bytes = 0;
+  while(*ptr) {
+    query_step_t step;
+    char* key = q->steps ? q->keys + bytes : NULL;
+    size_t keyLen = 0;
+    memset(&step, 0, sizeof(step));
+    step.type = QUERY_KEY;
+    if(pointer) {
+      for(++ptr; *ptr && *ptr != '/'; keyLen++) {
+        char ch = *ptr++;
+        if(ch == '~') {
+          if(*ptr != '0' && *ptr != '1') {
+            return false;
+          }
+          ch = *ptr++ == '0' ? '~' : '/';
+        }
+        if(key) {
+          key[keyLen] = ch;
+        }
+      }
+    } else if(*ptr == '[') {
+      ++ptr;
+      if(*ptr == '*') {
+        step.type = QUERY_ANY;
+        ++ptr;
+      } else if(query_index(&ptr, &step.index)) {
+        step.type = QUERY_INDEX;
+      } else {
+        return false;
+      }
+      if(*ptr++ != ']') {
+        return false;
+      }
+    } else {
+      if(count && *ptr++ != '.') { //后面的键名要用.隔开
+        return false;
+      }
+      if(ptr[0] == '*' && (!ptr[1] || ptr[1] == '.' || ptr[1] == '[')) {
+        step.type = QUERY_ANY;
+        ++ptr;
+      } else {
+        for(; *ptr && *ptr != '.' && *ptr != '['; keyLen++) {
+          if(*ptr == '\\' && ptr[1]) {
+            ++ptr;
+          }
+          if(key) {
+            key[keyLen] = *ptr;
+          }
+          ++ptr;
+        }
+        if(!keyLen) {
+          return false;
+        }
+      }
+    }
+    if(count == CJSON_QUERY_MAX_STEPS) {
+      return false;
+    }
+    if(step.type == QUERY_KEY) {
+      bytes += keyLen + 1;
+      if(key) {
+        const char* digits = key;
+        key[keyLen] = '\0';
+        step.key = key;
+        step.keyLen = keyLen;
+        step.hash = hash_key(key);
+        step.hasIndex = pointer && (keyLen == 1 || key[0] != '0') && query_index(&digits, &step.index) && !*digits;
+      }
+    }
+    if(q->steps) {
+      q->steps[count] = step;
+    }
+    count++;
+  }
+  q->count = count;
+  *keyBytes = bytes;
+  return true;
+}
+
+//编译查询路径，空字符串表示根节点本身；路径不合法，超过CJSON_QUERY_MAX_STEPS步或者没有内存时返回NULL
+CjsonQuery* cjson_query_compile(const char* path) {
+  return cjson_query_compile_ctx(&default_context, path);
+}
+
+//用上下文的allocator编译查询路径
+CjsonQuery* cjson_query_compile_ctx(CjsonContext* mem, const char* path) {
+  CjsonQuery probe;
+  size_t keyBytes;
+  memset(&probe, 0, sizeof(probe));
+  if(!path || !query_scan(path, &probe, &keyBytes)) {
+    return NULL;
+  }
+  CjsonQuery* q = (CjsonQuery*)mem->malloc_fn(sizeof(CjsonQuery) + probe.count * sizeof(query_step_t) + keyBytes + 1);
+  if(!q) {
+    return NULL;
+  }
+  q->steps = (query_step_t*)(q + 1);
+  q->keys = (char*)(q->steps + probe.count);
+  q->mem = mem;
+  query_scan(path, q, &keyBytes);
+  return q;
+}
+
+//释放编译好的查询
+void cjson_query_free(CjsonQuery* q) {
+  if(q) {
+    q->mem->free_fn(q);
+  }
+}
+
+//一步在parent上的第一个匹配，没有时返回NULL
+static const Cjson* query_first_match(const query_step_t* step, const Cjson* parent) {
+  switch(step->type) {
+    case QUERY_KEY:
+      if(parent->nodeType == NodeType_OBJECT) {
+        return object_find(parent, step->key, &step->hash, false, NULL);
+      }
+      //JSON Pointer的数字段在array上按下标取
+      return step->hasIndex ? array_at(parent, step->index, NULL) : NULL;
+    case QUERY_INDEX:
+      return array_at(parent, step->index, NULL);
+    case QUERY_ANY:
+      return parent->nodeType == NodeType_ARRAY || parent->nodeType == NodeType_OBJECT ? parent->child : NULL;
+  }
+  return NULL;
+}
+
+//同一步的下一个匹配，只有匹配所有成员的一步会有
+static const Cjson* query_next_match(const query_step_t* step, const Cjson* prev) {
+  return step->type == QUERY_ANY ? prev->next : NULL;
+}
+
+//在树上跑查询，按文档顺序对每个匹配调用visit，visit为NULL或者返回false时停止，返回停下时的匹配
+//每一步当前匹配的节点记在栈上，没有更多匹配时回到上一步，不分配内存
+static const Cjson* query_run(const CjsonQuery* q, const Cjson* root, bool (*visit)(void*, const Cjson*), void* userdata) {
+  const Cjson* matched[CJSON_QUERY_MAX_STEPS];
+  size_t level = 0;
+  if(!q || !root) {
+    return NULL;
+  }
+  if(!q->count) {
+    return !visit || !visit(userdata, root) ? root : NULL;
+  }
+  const Cjson* cur = query_first_match(&q->steps[0], root);
+  for(;;) {
+    if(!cur) { //这一步没有更多匹配，回到上一步
+      if(!level) {
+        return NULL;
+      }
+      level--;
+      cur = query_next_match(&q->steps[level], matched[level]);
+    } else if(level + 1 == q->count) {
+      if(!visit || !visit(userdata, cur)) {
+        return cur;
+      }
+      cur = query_next_match(&q->steps[level], cur);
+    } else {
+      matched[level++] = cur;
+      cur = query_first_match(&q->steps[level], cur);
+    }
+  }
+}
+
+//cjson_query_all收集匹配用的状态
+typedef struct {
+  Cjson** out;
+  size_t cap;
+  size_t count;
+} query_collect_t;
+
+static bool query_collect(void* userdata, const Cjson* item) {
+  query_collect_t* res = (query_collect_t*)userdata;
+  if(res->count < res->cap) {
+    res->out[res->count] = (Cjson*)item;
+  }
+  res->count++;
+  return true;
+}
+
+//第一个匹配的节点，没有时返回NULL；不分配内存，已经建过的索引和元素数组会用上，没有时逐个找
+Cjson* cjson_query_first(const CjsonQuery* q, const Cjson* root) {
+  return (Cjson*)query_run(q, root, NULL, NULL);
+}
+
+//按文档顺序把匹配的节点放到out里，最多放cap个，返回匹配的总数，比cap大时说明out放不下
+size_t cjson_query_all(const CjsonQuery* q, const Cjson* root, Cjson** out, size_t cap) {
+  query_collect_t res;
+  res.out = out;
+  res.cap = out ? cap : 0;
+  res.count = 0;
+  query_run(q, root, query_collect, &res);
+  return res.count;
+}
+
+//object在结构索引里index位置（左括号或者逗号）后面的成员的值，不是合法的成员时ptr为NULL
+static CjsonLazyValue lazy_member(const CjsonLazy* doc, uint32_t index) {
+  CjsonLazyValue res;
+  memset(&res, 0, sizeof(res));
+  if(doc->json[doc->pos[index + 1]] != '\"' || doc->json[doc->pos[index + 2]] != ':') {
+    return res; //空object或者不是键名
+  }
+  return lazy_value_after(doc, index + 2);
+}
+
+//一步在懒解析的值上的第一个匹配，不存在时ptr为NULL
+static CjsonLazyValue query_lazy_first(const query_step_t* step, CjsonLazyValue parent) {
+  CjsonLazyValue res;
+  nodetype_t type = cjson_lazy_type(parent);
+  memset(&res, 0, sizeof(res));
+  switch(step->type) {
+    case QUERY_KEY:
+      if(type == NodeType_OBJECT) {
+        return cjson_lazy_get(parent, step->key);
+      }
+      //JSON Pointer的数字段在array上按下标取
+      return step->hasIndex && type == NodeType_ARRAY ? cjson_lazy_at(parent, step->index) : res;
+    case QUERY_INDEX:
+      return type == NodeType_ARRAY ? cjson_lazy_at(parent, step->index) : res;
+    case QUERY_ANY:
+      if(type == NodeType_ARRAY) {
+        return cjson_lazy_at(parent, 0);
+      }
+      return type == NodeType_OBJECT ? lazy_member(parent.doc, parent.index) : res;
+  }
+  return res;
+}
+
+//同一步的下一个匹配，跳过前一个成员的整个子树
+static CjsonLazyValue query_lazy_next(const query_step_t* step, CjsonLazyValue prev) {
+  CjsonLazyValue res;
+  memset(&res, 0, sizeof(res));
+  if(step->type != QUERY_ANY) {
+    return res;
+  }
+  const CjsonLazy* doc = prev.doc;
+  uint32_t index = lazy_skip(prev);
+  if(doc->json[doc->pos[index]] != ',') {
+    return res;
+  }
+  if(doc->json[doc->pos[prev.index - 1]] == ':') { //前一个是object的成员
+    return lazy_member(doc, index);
+  }
+  return lazy_value_after(doc, index);
+}
+
+//用查询驱动解析：先建结构索引，沿着路径走，不匹配的子树整个跳过，只把匹配的值解析成节点
+//返回匹配的值按文档顺序组成的array，没有匹配时是空array；出错时返回NULL，原因和位置用cjson_last_error取
+Cjson* cjson_query_parse(const CjsonQuery* q, const char* json) {
+  return cjson_query_parse_ctx(&default_context, q, json);
+}
+
+//用上下文的allocator建索引和节点，返回的array用deleteCjson_ctx释放
+Cjson* cjson_query_parse_ctx(CjsonContext* mem, const CjsonQuery* q, const char* json) {
+  CjsonLazyValue matched[CJSON_QUERY_MAX_STEPS];
+  size_t level = 0;
+  if(!q) {
+    parse_report("no query");
+    return NULL;
+  }
+  CjsonLazy* doc = cjson_lazy_parse_ctx(mem, json);
+  if(!doc) {
+    return NULL;
+  }
+  Cjson* res = create_new_node_ctx(mem, NodeType_ARRAY);
+  Cjson* last = NULL;
+  CjsonLazyValue cur = cjson_lazy_root(doc);
+  if(q->count && cur.ptr) {
+    cur = query_lazy_first(&q->steps[0], cur);
+  }
+  while(res) {
+    if(!cur.ptr) { //这一步没有更多匹配，回到上一步
+      if(!level) {
+        break;
+      }
+      level--;
+      cur = query_lazy_next(&q->steps[level], matched[level]);
+    } else if(level + 1 >= q->count) {
+      Cjson* item = cjson_lazy_materialize(cur);
+      if(!item) {
+        deleteCjson_ctx(mem, res);
+        res = NULL;
+        break;
+      }
+      if(last) {
+        link_next(last, item);
+      } else {
+        res->child = item;
+      }
+      last = item;
+      if(!q->count) {
+        break;
+      }
+      cur = query_lazy_next(&q->steps[level], cur);
+    } else {
+      matched[level++] = cur;
+      cur = query_lazy_first(&q->steps[level], cur);
+    }
+  }
+  cjson_lazy_free(doc);
+  if(!res) {
+    if(!cjson_last_error()->reason) {
+      parse_report("out of memory");
+    }
+    return NULL;
+  }
+  memset(&last_error, 0, sizeof(last_error));
+  return res;
+}
+
+//多线程解析：大的顶层array按成员边界切成几段，ndjson按行切，每段一个线程
+#ifndef CJSON_NO_THREADS
+#include <pthread.h>
+#include <unistd.h>
+#endif
+
+//一个线程解析的一段，[start, end)里是完整的若干个值
+typedef struct {
+  const char* doc; //整个输入的开头，算出错的行列用
+  const char* start;
+  const char* end; //顶层array的最后一段为NULL，到右括号为止
+  bool ndjson;
+  CjsonContext* mem; //只用它的allocator，临时空间每个线程自己的
+  Cjson* head; //解析出来的值按顺序链好
+  Cjson* tail;
+  CjsonError error; //这一段出错时的原因和位置，reason为NULL表示没出错
+} parallel_task_t;
+
+//找顶层array的切分点：离每个目标位置最近的后面那个第一层逗号
+//和结构索引一样按64字节一块处理字符串和转义，目标位置前面的块只用popcount更新层数
+static int parallel_split_array(const char* str, size_t len, int parts, const char** cuts) {
+  uint64_t prevEscaped = 0, prevInString = 0;
+  long depth = 0;
+  int found = 0;
+  size_t target = len / parts;
+  char tail[64];
+  for(size_t offset = 0; offset < len && found < parts - 1; offset += 64) {
+    const char* block = str + offset;
+    lazy_block_t m;
+    if(len - offset < 64) {
+      memset(tail, ' ', sizeof(tail));
+      memcpy(tail, block, len - offset);
+      block = tail;
+    }
+    lazy_masks(block, &m);
+    uint64_t quote = m.quote & ~lazy_escaped(m.backslash, &prevEscaped),
+      inString = prefix_xor(quote) ^ prevInString;
+    prevInString = (uint64_t)((int64_t)inString >> 63);
+    uint64_t open = m.open & ~inString, close = m.close & ~inString;
+    if(offset + 64 <= target) {
+      depth += __builtin_popcountll(open) - __builtin_popcountll(close);
+      continue;
+    }
+    uint64_t bits = m.structural & ~inString;
+    while(bits && found < parts - 1) {
+      int i = __builtin_ctzll(bits);
+      uint64_t bit = (uint64_t)1 << i;
+      bits &= bits - 1;
+      if(open & bit) {
+        ++depth;
+      } else if(close & bit) {
+        --depth;
+      } else if(depth == 1 && block[i] == ',' && offset + i >= target) {
+        cuts[found++] = str + offset + i;
+        target = len / parts * (found + 1);
+      }
+    }
+  }
+  return found;
+}
+
+//ndjson按换行切分，json字符串里不会有没转义的换行
+static int parallel_split_lines(const char* str, size_t len, int parts, const char** cuts) {
+  int found = 0;
+  const char* from = str;
+  for(int k = 1; k < parts; k++) {
+    const char* target = str + len / parts * k;
+    if(target < from) {
+      continue;
+    }
+    const char* cut = (const char*)memchr(target, '\n', str + len - target);
+    if(!cut) {
+      break;
+    }
+    cuts[found++] = cut;
+    from = cut + 1;
+  }
+  return found;
+}
+
+//解析一段里的所有值，同一个解析状态反复用，每个值解析完链到上一个后面
+//出错时释放这一段已经解析的值，错误记在task里
+static void* parallel_worker(void* arg) {
+  parallel_task_t* task = (parallel_task_t*)arg;
+  CjsonContext mem = {task->mem->malloc_fn, task->mem->free_fn, NULL, 0}; //上下文的临时空间不能多个线程共用
+  parse_context_t ctx;
+  const char* ptr = skip_space(task->start);
+  parse_init(&ctx, &mem);
+  ctx.start = task->doc;
+  task->head = task->tail = NULL;
+  memset(&task->error, 0, sizeof(task->error));
+  if(!task->ndjson && !task->end && *ptr == ']') {
+    return NULL; //空array
+  }
+  while(task->end ? ptr < task->end : *ptr != '\0') {
+    ctx.state = PARSE_VALUE;
+    ctx.root = NULL;
+    ptr = parse_run(ptr, &ctx);
+    if(!ptr) {
+      break;
+    }
+    ptr = skip_space(ptr);
+    if(task->tail) {
+      link_next(task->tail, ctx.root);
+    } else {
+      task->head = ctx.root;
+    }
+    task->tail = ctx.root;
+    if(task->ndjson || (task->end && ptr == task->end)) {
+      continue;
+    }
+    if(*ptr == ',') {
+      ptr = skip_space(ptr + 1);
+    } else if(*ptr == ']' && !task->end) {
+      break;
+    } else {
+      ctx.root = NULL;
+      parse_fail(&ctx.error, ptr, *ptr ? "expected , or ] in array" : "unexpected end of input");
+      break;
+    }
+  }
+  parse_release(&ctx);
+  if(ctx.error.reason) {
+    parse_abort(&ctx, &task->error);
+    task->head = task->tail = deleteCjson_ctx(&mem, task->head);
+  }
+  cjson_context_release(&mem);
+  return NULL;
+}
+
+//按切分点分好段，开线程解析，当前线程解析第一段，最后把各段的值接成一个array
+//有一段出错时释放所有段，返回NULL，报告最前面那一段的错误
+static Cjson* parallel_run(CjsonContext* mem, const char* doc, const char* start, const char** cuts, int count, bool ndjson) {
+  parallel_task_t localTasks[16], *tasks = localTasks;
+  if(count + 1 > 16) {
+    tasks = (parallel_task_t*)mem->malloc_fn((count + 1) * sizeof(parallel_task_t));
+    if(!tasks) {
+      count = 0; //内存不够就只用当前线程解析整段
+      cuts = NULL;
+      tasks = localTasks;
+    }
+  }
+  for(int k = 0; k <= count; k++) {
+    tasks[k].doc = doc;
+    tasks[k].start = k ? cuts[k - 1] + 1 : start;
+    tasks[k].end = k < count ? cuts[k] : NULL;
+    tasks[k].ndjson = ndjson;
+    tasks[k].mem = mem;
+  }
+#ifndef CJSON_NO_THREADS
+  pthread_t localThreads[16], *threads = localThreads;
+  int started = 0, most = count;
+  if(count > 16) {
+    threads = (pthread_t*)mem->malloc_fn(count * sizeof(pthread_t));
+    if(!threads) {
+      threads = localThreads;
+      most = 16; //只开16个线程，剩下的段在当前线程解析
+    }
+  }
+  for(; started < most; started++) {
+    if(pthread_create(&threads[started], NULL, parallel_worker, &tasks[started + 1])) {
+      break; //开不了线程就留给当前线程
+    }
+  }
+  parallel_worker(&tasks[0]);
+  for(int k = started; k < count; k++) {
+    parallel_worker(&tasks[k + 1]);
+  }
+  for(int k = 0; k < started; k++) {
+    pthread_join(threads[k], NULL);
+  }
+  if(threads != localThreads) {
+    mem->free_fn(threads);
+  }
+#else
+  for(int k = 0; k <= count; k++) {
+    parallel_worker(&tasks[k]);
+  }
+#endif
+  Cjson* arr = NULL, *last = NULL;
+  const CjsonError* error = NULL;
+  for(int k = 0; k <= count && !error; k++) {
+    if(tasks[k].error.reason) {
+      error = &tasks[k].error;
+    }
+  }
+  if(!error && !(arr = create_new_node_ctx(mem, NodeType_ARRAY))) {
+    static const CjsonError outOfMemory = {0, 1, 1, "out of memory"};
+    error = &outOfMemory;
+  }
+  for(int k = 0; k <= count; k++) {
+    if(!tasks[k].head) {
+      continue;
+    }
+    if(error) { //出错的段已经自己释放了，其他段也不要了
+      deleteCjson_ctx(mem, tasks[k].head);
+      continue;
+    }
+    if(last) { //整段链表接上去，link_next只插入一个节点
+      last->next = tasks[k].head;
+#ifndef CJSON_SINGLY_LINKED
+      tasks[k].head->prev = last;
+#endif
+    } else {
+      arr->child = tasks[k].head;
+    }
+    last = tasks[k].tail;
+  }
+  if(error) {
+    last_error = *error;
+  } else {
+    memset(&last_error, 0, sizeof(last_error));
+  }
+  if(tasks != localTasks) {
+    mem->free_fn(tasks);
+  }
+  return arr;
+}
+
+//线程数，threads不大于0时用cpu核数；每段至少CJSON_PARALLEL_MIN_CHUNK字节
+static int parallel_parts(size_t len, int threads) {
+  if(threads <= 0) {
+#ifndef CJSON_NO_THREADS
+    long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+    threads = cpus > 0 ? (int)cpus : 1;
+#else
+    threads = 1;
+#endif
+  }
+  size_t most = len / CJSON_PARALLEL_MIN_CHUNK + 1;
+  return most < (size_t)threads ? (int)most : threads;
+}
+
+//多线程解析顶层是array的json，根不是array时和cjson_parse一样，出错时返回NULL
+Cjson* cjson_parse_parallel(const char* str, int threads) {
+  return cjson_parse_parallel_ctx(&default_context, str, threads);
+}
+
+//用上下文的allocator多线程解析，allocator要能在多个线程里同时用，树用deleteCjson_ctx释放
+Cjson* cjson_parse_parallel_ctx(CjsonContext* mem, const char* str, int threads) {
+  const char* ptr = skip_space(str);
+  if(*ptr != '[') {
+    return cjson_parse_ctx(mem, str);
+  }
+  size_t len = strlen(ptr);
+  int parts = parallel_parts(len, threads);
+  const char* localCuts[16], **cuts = localCuts;
+  if(parts > 16) {
+    cuts = (const char**)mem->malloc_fn(parts * sizeof(const char*));
+    if(!cuts) {
+      cuts = localCuts;
+      parts = 16;
+    }
+  }
+  int count = parallel_split_array(ptr, len, parts, cuts);
+  Cjson* arr = parallel_run(mem, str, ptr + 1, cuts, count, false);
+  if(cuts != localCuts) {
+    mem->free_fn(cuts);
+  }
+  return arr;
+}
+
+//多线程解析ndjson，每行一个json，返回的array按顺序包含每行的树，有一行出错时返回NULL
+Cjson* cjson_parse_ndjson(const char* str, int threads) {
+  return cjson_parse_ndjson_ctx(&default_context, str, threads);
+}
+
+//用上下文的allocator多线程解析ndjson，allocator要能在多个线程里同时用
+Cjson* cjson_parse_ndjson_ctx(CjsonContext* mem, const char* str, int threads) {
+  size_t len = strlen(str);
+  int parts = parallel_parts(len, threads);
+  const char* localCuts[16], **cuts = localCuts;
+  if(parts > 16) {
+    cuts = (const char**)mem->malloc_fn(parts * sizeof(const char*));
+    if(!cuts) {
+      cuts = localCuts;
+      parts = 16;
+    }
+  }
+  int count = parallel_split_lines(str, len, parts, cuts);
+  Cjson* arr = parallel_run(mem, str, str, cuts, count, true);
+  if(cuts != localCuts) {
+    mem->free_fn(cuts);
+  }
+  return arr;
 }
 
-//计算前导代理和后尾代理
-static int compute_hex(const char** ptr) {
-  int res = 0x00,
-   lowChar;
-  for(int i = 4; i > 0; i--) {
-    if(**ptr >= '0' && **ptr <= '9') {
-      res += **ptr - '0';
-    } else{
-      lowChar = tolower(**ptr);
-      if(lowChar <= 'f' && lowChar >= 'a') {
-        res += lowChar + 10 - 'a';
-      } else {
-        printf("utf-16 must be hex, error in compute_hex method");
-        exit(1);
-      }
-    }
-    if(i != 1){
-      res *= 16;
-      ++(*ptr);
+//解析文件：文件映射到内存里直接解析，不用先读到一块malloc的缓冲区里
+//映射后面补一个全是0的页，文件内容后面总有\0，长度正好是页大小的整数倍时也不用复制
+#if !defined(CJSON_NO_MMAP) && (defined(__unix__) || defined(__APPLE__))
+#define CJSON_MMAP 1
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+//映射好的文件，cjson_file_parse解析出来的树里的字符串指向它
+struct _cjson_file {
+  CjsonContext* mem; //树，映射和这个结构都用它释放
+  Cjson* root;
+  char* data; //文件内容，后面跟着\0
+  size_t mapLen; //映射的长度，为0时data是malloc的
+};
+
+//打开文件并映射到内存，writable时映射是私有的，写入不会改到文件，只有写过的页才复制
+//不能映射时用mem分配缓冲区读进来；size带回文件内容的长度，出错时返回NULL，原因放在reason里
+static char* map_file(CjsonContext* mem, const char* path, bool writable, size_t* size, size_t* mapLen, const char** reason) {
+#ifdef CJSON_MMAP
+  (void)mem; //映射不用分配
+  struct stat st;
+  int fd = open(path, O_RDONLY);
+  if(fd < 0) {
+    *reason = "cannot open file";
+    return NULL;
+  }
+  if(fstat(fd, &st) < 0 || !S_ISREG(st.st_mode)) {
+    close(fd);
+    *reason = "not a regular file";
+    return NULL;
+  }
+  size_t len = (size_t)st.st_size, page = (size_t)sysconf(_SC_PAGESIZE),
+    fileLen = (len + page - 1) / page * page; //文件最后一页超出文件的部分内核填0
+  int prot = PROT_READ | (writable ? PROT_WRITE : 0);
+  char* data = (char*)mmap(NULL, fileLen + page, prot, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0); //先占好多一页的地址
+  if(data == (char*)MAP_FAILED) {
+    close(fd);
+    *reason = "out of memory";
+    return NULL;
+  }
+  if(len && mmap(data, fileLen, prot, MAP_PRIVATE | MAP_FIXED, fd, 0) == MAP_FAILED) {
+    munmap(data, fileLen + page);
+    close(fd);
+    *reason = "cannot map file";
+    return NULL;
+  }
+  close(fd);
+  if(len) {
+    madvise(data, fileLen, MADV_SEQUENTIAL); //解析从头读到尾
+  }
+  *size = len;
+  *mapLen = fileLen + page;
+  return data;
+#else
+  (void)writable;
+  FILE* file = fopen(path, "rb");
+  long len;
+  char* data = NULL;
+  if(!file) {
+    *reason = "cannot open file";
+    return NULL;
+  }
+  if(fseek(file, 0, SEEK_END) == 0 && (len = ftell(file)) >= 0 && fseek(file, 0, SEEK_SET) == 0) {
+    data = (char*)mem->malloc_fn((size_t)len + 1);
+    *reason = "out of memory";
+    if(data && fread(data, 1, (size_t)len, file) != (size_t)len) {
+      mem->free_fn(data);
+      data = NULL;
+      *reason = "cannot read file";
     }
+  } else {
+    *reason = "cannot read file";
   }
-  return res;
+  fclose(file);
+  if(data) {
+    data[len] = '\0';
+    *size = (size_t)len;
+  }
+  *mapLen = 0;
+  return data;
+#endif
 }
 
-//设置nodeType
-static void set_nodeType(Cjson* item, nodetype_t nodeType) {
-  if(item && nodeType) {
-    item->nodeType = nodeType;
+//释放map_file映射的内容
+static void unmap_file(CjsonContext* mem, char* data, size_t mapLen) {
+#ifdef CJSON_MMAP
+  if(mapLen) {
+    munmap(data, mapLen);
+    return ;
   }
+#endif
+  mem->free_fn(data);
 }
 
-//解析数字
-static const char* parse_number(const char* str, Cjson* out) {
-  const char* ptr = str;
-  char* end;
-  double num;
-  num = strtod(str, &end);
-  if(num - 0 < DBL_EPSILON && end == str) {
-    printf("str is not a number, error in parse_number function");
-    exit(1);
-  }
-  ptr = end;
-  if(fabs(num - (int)num) < DBL_EPSILON) {
-    out->value.intNum = num;
-    out->isInt = true;
-  } else {
-    out->value.doubleNum = num;
-    out->isInt = false;
+//解析文件，树里的字符串都复制出来，返回前就解除映射；出错时返回NULL，原因和位置用cjson_last_error取
+Cjson* cjson_parse_file(const char* path) {
+  return cjson_parse_file_ctx(&default_context, path);
+}
+
+//用上下文的allocator解析文件，树用deleteCjson_ctx释放
+Cjson* cjson_parse_file_ctx(CjsonContext* mem, const char* path) {
+  const char* reason;
+  size_t size, mapLen;
+  char* data = map_file(mem, path, false, &size, &mapLen, &reason);
+  if(!data) {
+    parse_report(reason);
+    return NULL;
   }
-  return ptr;
+  Cjson* root = cjson_parse_n_ctx(mem, data, size); //文件里有\0时也按整个文件解析，报错而不是截断
+  unmap_file(mem, data, mapLen);
+  return root;
 }
 
-//解析对象
-static const char* parse_object(const char* str, Cjson* out) {
-  const char *ptr = str;
-  Cjson* cur = out;
-  bool firstContentKey = true; //标识对象的第一个属性
-  if(*ptr++ != '{') {
-    printf("error in parse_object method\n");
-    exit(1);
-  }
-  if(*ptr == '}') {
-    return ++ptr;
-  }
-
-  while(firstContentKey || *ptr == ',') {
-    *ptr == ',' && ++ptr;
-    Cjson *child = create_new_node(NOTYPE);
-    if(firstContentKey) {
-      cur->child = child;
-      firstContentKey = false;
-    } else {
-      cur = add_next(cur, child);
-    }
-    
-    ptr = skip_space(ptr);
-    if(*ptr != '\"') {
-      printf("object need name, error in parse_object");
-      exit(1);
-    }
-    ptr = parse_value(ptr, child);
-    if(child->nodeType != NodeType_STRING) {
-      printf("keyNmae must be string type");
-      exit(1);
+//映射文件后原地解析，键名和字符串直接指向映射，映射和树一起用cjson_file_free释放
+//映射是私有的，原地解码只复制有字符串的页，文件本身不会被修改
+CjsonFile* cjson_file_parse(const char* path) {
+  return cjson_file_parse_ctx(&default_context, path);
+}
+
+//用上下文的allocator映射文件后原地解析，按文件长度解析，不依赖映射后面补的\0
+CjsonFile* cjson_file_parse_ctx(CjsonContext* mem, const char* path) {
+  const char* reason;
+  size_t size;
+  CjsonFile* file = (CjsonFile*)mem->malloc_fn(sizeof(CjsonFile));
+  if(!file) {
+    parse_report("out of memory");
+    return NULL;
+  }
+  file->mem = mem;
+  file->data = map_file(mem, path, true, &size, &file->mapLen, &reason);
+  if(!file->data) {
+    mem->free_fn(file);
+    parse_report(reason);
+    return NULL;
+  }
+  file->root = parse_insitu_n(mem, file->data, size);
+  if(!file->root) {
+    cjson_file_free(file);
+    return NULL;
+  }
+  return file;
+}
+
+//cjson_file_parse解析出来的树，归CjsonFile所有，不要单独删除
+Cjson* cjson_file_root(const CjsonFile* file) {
+  return file->root;
+}
+
+//删除树，解除映射
+void cjson_file_free(CjsonFile* file) {
+  if(!file) {
+    return ;
+  }
+  CjsonContext* mem = file->mem;
+  deleteCjson_ctx(mem, file->root);
+  unmap_file(mem, file->data, file->mapLen);
+  mem->free_fn(file);
+}
+
+//流式输出到文件描述符用posix的write
+#if defined(__unix__) || defined(__APPLE__)
+#define CJSON_FD_IO 1
+#include <errno.h>
+#include <unistd.h>
+#endif
+
+//输出json节点总入口
+const char* print_json(const Cjson* out) {
+  return print_json_ctx(&default_context, out);
+}
+
+//用上下文的allocator输出，返回的字符串用上下文的free_fn释放
+const char* print_json_ctx(CjsonContext* mem, const Cjson* out) {
+  return print_json_opts_ctx(mem, out, NULL);
+}
+
+//按选项输出到一块新的内存，opts为NULL时和print_json一样
+const char* print_json_opts(const Cjson* out, const CjsonPrintOptions* opts) {
+  return print_json_opts_ctx(&default_context, out, opts);
+}
+
+//用上下文的allocator按选项输出，输出和排序用的临时空间都用它分配，返回的字符串用上下文的free_fn释放
+const char* print_json_opts_ctx(CjsonContext* mem, const Cjson* out, const CjsonPrintOptions* opts) {
+  printbuffer_t p;
+  print_setup(&p, mem, opts);
+  p.length = 256;
+  p.buffer = (char*)mem->malloc_fn(p.length);
+  if(!p.buffer) {
+    return NULL;
+  }
+  if(!print_value(out, &p)) {
+    mem->free_fn(p.buffer);
+    return NULL;
+  }
+  p.buffer[p.offset] = '\0';
+  return p.buffer;
+}
+
+//分块输出，每块最多CJSON_PRINT_CHUNK字节交给write，write返回false时停止并返回false
+bool cjson_print_stream(const Cjson* out, const CjsonPrintOptions* opts, cjson_write_fn write, void* userdata) {
+  return cjson_print_stream_ctx(&default_context, out, opts, write, userdata);
+}
+
+//用上下文的allocator分块输出，排序和很深的嵌套用的临时空间从它分配
+bool cjson_print_stream_ctx(CjsonContext* mem, const Cjson* out, const CjsonPrintOptions* opts, cjson_write_fn write, void* userdata) {
+  if(!write) {
+    return false;
+  }
+  return print_stream(mem, out, opts, write, userdata);
+}
+
+//写到FILE里的写函数
+static bool write_file(void* userdata, const char* data, size_t len) {
+  return fwrite(data, 1, len, (FILE*)userdata) == len;
+}
+
+//输出到打开的文件里，不会flush文件
+bool cjson_print_file(const Cjson* out, const CjsonPrintOptions* opts, FILE* fp) {
+  return cjson_print_file_ctx(&default_context, out, opts, fp);
+}
+
+//用上下文的allocator输出到打开的文件里
+bool cjson_print_file_ctx(CjsonContext* mem, const Cjson* out, const CjsonPrintOptions* opts, FILE* fp) {
+  if(!fp) {
+    return false;
+  }
+  return print_stream(mem, out, opts, write_file, fp);
+}
+
+#ifdef CJSON_FD_IO
+//写到文件描述符的写函数，写了一部分或者被信号打断时接着写
+static bool write_fd(void* userdata, const char* data, size_t len) {
+  int fd = *(int*)userdata;
+  while(len) {
+    ssize_t n = write(fd, data, len);
+    if(n < 0 && errno == EINTR) {
+      continue;
     }
-    child->keyName = child->value.complex;
-    child->value.complex = NULL;
-    ptr = skip_space(ptr);
-    if(*ptr++ != ':') {
-      printf("object need : after keyName, error in parse_object");
-      exit(1);
+    if(n <= 0) {
+      return false;
     }
-    ptr = skip_space(ptr);
-    ptr = parse_value(ptr, child);
-    ptr = skip_space(ptr);
-    cur = child;
+    data += n;
+    len -= (size_t)n;
   }
-  
-  if(*ptr++ != '}') {
-    printf("end object must be a }, error in parse_object");
-    exit(1);
+  return true;
+}
+#endif
+
+//输出到文件描述符，没有posix的write时返回false
+bool cjson_print_fd(const Cjson* out, const CjsonPrintOptions* opts, int fd) {
+  return cjson_print_fd_ctx(&default_context, out, opts, fd);
+}
+
+//用上下文的allocator输出到文件描述符
+bool cjson_print_fd_ctx(CjsonContext* mem, const Cjson* out, const CjsonPrintOptions* opts, int fd) {
+#ifdef CJSON_FD_IO
+  if(fd < 0) {
+    return false;
   }
-  return ptr;
+  return print_stream(mem, out, opts, write_fd, &fd);
+#else
+  return false;
+#endif
 }
 
-//跳过空白
-static const char* skip_space(const char* str) {
-  while(str && (*str < 32 || *str == ' ')) {
-    str++;
+//分块输出给写函数，缓冲区在栈上，大小固定
+static bool print_stream(CjsonContext* mem, const Cjson* out, const CjsonPrintOptions* opts, cjson_write_fn write, void* userdata) {
+  char chunk[CJSON_PRINT_CHUNK];
+  printbuffer_t p;
+  print_setup(&p, mem, opts);
+  p.buffer = chunk;
+  p.length = sizeof(chunk);
+  p.noalloc = true;
+  p.sink = write;
+  p.sinkData = userdata;
+  return print_value(out, &p) && print_flush(&p);
+}
+
+//按输出选项初始化缓冲区，opts为NULL时紧凑输出，非ascii字符转义，和print_json一样；临时空间用mem分配
+static void print_setup(printbuffer_t* p, CjsonContext* mem, const CjsonPrintOptions* opts) {
+  memset(p, 0, sizeof(*p));
+  p->mem = mem;
+  if(opts) {
+    p->indent = opts->indent > 0 ? opts->indent : 0;
+    p->sortKeys = opts->sortKeys;
+    p->asciiOnly = opts->asciiOnly;
+  } else {
+    p->asciiOnly = true;
   }
-  return str;
 }
 
-//添加下一个节点
-Cjson* add_next(Cjson* cur, Cjson* next) {
-  if(!cur) {
-    printf("can not add next node without current one, error in add_next function");
-    exit(1);
+//输出到调用者提供的缓冲区，written不包含结尾的\0
+bool print_json_into(const Cjson* out, char* buf, size_t cap, size_t* written) {
+  printbuffer_t p;
+  if(!buf || cap == 0) {
+    return false;
   }
-  if(cur->next) {
-    next->next = cur->next;
-    cur->prev = next;
+  print_setup(&p, &default_context, NULL);
+  p.buffer = buf;
+  p.length = cap;
+  p.noalloc = true; //只有嵌套很深时输出栈要分配
+  if(!print_value(out, &p) || p.offset >= cap) {
+    if(written)
+      *written = 0;
+    buf[0] = '\0';
+    return false;
   }
-  cur->next = next;
-  next->prev = cur;
-  return cur;
+  buf[p.offset] = '\0';
+  if(written)
+    *written = p.offset;
+  return true;
 }
 
-//解析数组
-static const char* parse_array(const char* str, Cjson* out) {
-  const char* ptr = str;
-  bool firstArrayItemFlag = true; //标志第一个数组对象，因为第一个开头不是，
-  if(!out) {
-    printf("out cant not be a NULL pointer, error in parse_array method");
-    exit(1);
+//保证缓冲区还有needed字节可写，返回写入位置，空间不够或者没有内存时返回NULL
+//流式输出时先把缓冲区交给sink再从头写，调用的地方每次要的空间都比缓冲区小
+static char* ensure(printbuffer_t* p, size_t needed) {
+  if(p->offset + needed + 1 <= p->length) { //为结尾的\0留位置
+    return p->buffer + p->offset;
   }
-  Cjson* cur = out;
-  while(firstArrayItemFlag || *ptr == ',') {
-    ++ptr;
-    Cjson* newOne = create_new_node(NOTYPE);
-    if(firstArrayItemFlag) {
-      firstArrayItemFlag = false;
-      cur->child = newOne;
-    } else {
-      cur = add_next(cur, newOne);
+  if(p->sink) {
+    if(needed + 1 > p->length || !print_flush(p)) {
+      return NULL;
     }
-    cur = newOne;
-    ptr = skip_space(ptr);  
-    ptr = parse_value(ptr, cur);
-    ptr = skip_space(ptr);
+    return p->buffer;
+  }
+  if(p->noalloc) {
+    return NULL;
   }
+  needed += p->offset + 1;
+  size_t newLen = p->length;
+  while(newLen < needed)
+    newLen *= 2;
+  char* tmp = (char*)p->mem->malloc_fn(newLen);
+  if(!tmp) {
+    return NULL;
+  }
+  memcpy(tmp, p->buffer, p->offset);
+  p->mem->free_fn(p->buffer);
+  p->buffer = tmp;
+  p->length = newLen;
+  return p->buffer + p->offset;
+}
 
-  if(*ptr++ != ']') {
-    printf("array must end with a ], error in parse_array method \n");
-    exit(1);
+//缓冲区里的内容交给sink，清空缓冲区
+static bool print_flush(printbuffer_t* p) {
+  if(!p->offset) {
+    return true;
   }
-  return ptr;
+  bool res = p->sink(p->sinkData, p->buffer, p->offset);
+  p->offset = 0;
+  return res;
 }
 
- //删除Cjson对象
-Cjson* deleteCjson(Cjson* out) {
-  if(out->child) {
-    deleteCjson(out->child);
+//输出一段内容，流式输出时长的内容分几次写，不用比缓冲区大的空间
+static bool print_bytes(printbuffer_t* p, const char* data, size_t len) {
+  while(len) {
+    size_t n = p->sink && len > p->length / 2 ? p->length / 2 : len;
+    char* res = ensure(p, n);
+    if(!res) {
+      return false;
+    }
+    memcpy(res, data, n);
+    p->offset += n;
+    data += n;
+    len -= n;
   }
-  if(out->keyName) 
-   cjson_free(out->keyName);
-  if(out->nodeType != NodeType_NUMBER) {
-    cjson_free(out->value.complex);
+  return true;
+}
+
+//缩进输出时换行，再缩进depth层，紧凑输出时什么也不做
+static bool print_newline(printbuffer_t* p, size_t depth) {
+  if(!p->indent) {
+    return true;
+  }
+  if(!print_char(p, '\n')) {
+    return false;
+  }
+  size_t spaces = depth * p->indent;
+  while(spaces) {
+    size_t n = spaces < 64 ? spaces : 64;
+    char* res = ensure(p, n);
+    if(!res) {
+      return false;
+    }
+    memset(res, ' ', n);
+    p->offset += n;
+    spaces -= n;
   }
-  Cjson* next = out->next;
-  cjson_free(out);
-  if(next)
-    deleteCjson(next);
+  return true;
 }
 
-//输出json节点总入口
-const char* print_json(const Cjson* out) {
-  const char* res = NULL;
-  switch (out->nodeType)
-  {
-    case NodeType_NULL:
-      res = print_null(out);
-      break;
-    case NodeType_FALSE:
-      res = print_false(out);
-      break;
-    case  NodeType_TRUE:
-      res = print_true(out);
-      break;
-    case NodeType_STRING:
-      res = print_string(out);
-      break;
-    case NodeType_NUMBER:
-      res = print_number(out);
-      break;
-    case NodeType_ARRAY:
-      res = print_array(out);
-      break;
-    case NodeType_OBJECT:
-      res = print_object(out);
+//输出一个字符
+static bool print_char(printbuffer_t* p, char c) {
+  char* res = ensure(p, 1);
+  if(!res) {
+    return false;
+  }
+  *res = c;
+  p->offset++;
+  return true;
+}
+
+//输出各种类型的值，用显式的栈代替递归，只输出out本身不输出它后面的兄弟节点
+static bool print_value(const Cjson* out, printbuffer_t* p) {
+  print_frame_t localStack[32], *stack = localStack; //嵌套不深时不用分配
+  size_t depth = 0, stackCap = sizeof(localStack) / sizeof(localStack[0]);
+  const Cjson* cur = out;
+  const Cjson* next = NULL;
+  bool res = true;
+  for(;;) {
+    if(depth && stack[depth - 1].container->nodeType == NodeType_OBJECT) { //object的成员先输出键
+      if(!cur->keyName || !print_string(cur->keyName, p) || !print_char(p, ':') ||
+        (p->indent && !print_char(p, ' '))) { //object的成员必须有键名
+        res = false;
+        break;
+      }
+    }
+    switch (cur->nodeType)
+    {
+      case NodeType_NULL:
+        res = print_null(cur, p);
+        break;
+      case NodeType_FALSE:
+        res = print_false(cur, p);
+        break;
+      case  NodeType_TRUE:
+        res = print_true(cur, p);
+        break;
+      case NodeType_STRING:
+        res = print_string(cur->value.complex, p);
+        break;
+      case NodeType_NUMBER:
+        res = print_number(cur, p);
+        break;
+      case NodeType_ARRAY:
+      case NodeType_OBJECT:
+        res = print_char(p, cur->nodeType == NodeType_OBJECT ? '{' : '[');
+        if(res && cur->child) { //进入容器，先输出第一个成员
+          if(depth == stackCap) {
+            print_frame_t* tmp = (print_frame_t*)p->mem->malloc_fn(stackCap * 2 * sizeof(print_frame_t));
+            if(!tmp) {
+              res = false;
+              break;
+            }
+            memcpy(tmp, stack, depth * sizeof(print_frame_t));
+            if(stack != localStack)
+              p->mem->free_fn(stack);
+            stack = tmp;
+            stackCap *= 2;
+          }
+          if(!print_enter(&stack[depth], cur, p)) {
+            res = false;
+            break;
+          }
+          cur = stack[depth].order ? stack[depth].order[0].node : cur->child;
+          depth++;
+          res = print_newline(p, depth);
+          if(!res) {
+            break;
+          }
+          continue;
+        }
+        res = res && print_char(p, cur->nodeType == NodeType_OBJECT ? '}' : ']');
+        break;
+      default:
+        res = false;
+        break;
+    }
+    while(res && depth && !(next = print_next(&stack[depth - 1], cur))) { //最后一个成员，容器结束
+      --depth;
+      cur = stack[depth].container;
+      if(stack[depth].order) {
+        p->mem->free_fn(stack[depth].order);
+      }
+      res = print_newline(p, depth) && print_char(p, cur->nodeType == NodeType_OBJECT ? '}' : ']');
+    }
+    if(!res || !depth) {
       break;
-    default:
+    }
+    cur = next;
+    if(!print_char(p, ',') || !print_newline(p, depth)) {
+      res = false;
       break;
+    }
+  }
+  while(depth) { //出错时还没输出完的容器
+    --depth;
+    if(stack[depth].order) {
+      p->mem->free_fn(stack[depth].order);
+    }
+  }
+  if(stack != localStack) {
+    p->mem->free_fn(stack);
   }
   return res;
 }
 
+//进入容器，要排序时把object的成员按键名排好放在order里，成员少于2个时不用排
+static bool print_enter(print_frame_t* frame, const Cjson* container, printbuffer_t* p) {
+  frame->container = container;
+  frame->order = NULL;
+  frame->index = 0;
+  frame->count = 0;
+  if(!p->sortKeys || container->nodeType != NodeType_OBJECT || !container->child->next) {
+    return true;
+  }
+  size_t count = 0;
+  for(const Cjson* item = container->child; item; item = item->next) {
+    count++;
+  }
+  print_member_t* order = (print_member_t*)p->mem->malloc_fn(count * sizeof(print_member_t));
+  if(!order) {
+    return false;
+  }
+  count = 0;
+  for(const Cjson* item = container->child; item; item = item->next) {
+    order[count].node = item;
+    order[count].pos = count;
+    count++;
+  }
+  qsort(order, count, sizeof(print_member_t), compare_member);
+  frame->order = order;
+  frame->count = count;
+  return true;
+}
+
+//容器里的下一个成员，排序时按order的顺序，没有了返回NULL
+static const Cjson* print_next(print_frame_t* frame, const Cjson* cur) {
+  if(!frame->order) {
+    return cur->next;
+  }
+  return ++frame->index < frame->count ? frame->order[frame->index].node : NULL;
+}
+
+//按键名比较成员，键名相同时按原来的位置，排序结果是稳定的
+static int compare_member(const void* a, const void* b) {
+  const print_member_t* x = (const print_member_t*)a;
+  const print_member_t* y = (const print_member_t*)b;
+  int res = strcmp(x->node->keyName ? x->node->keyName : "", y->node->keyName ? y->node->keyName : "");
+  if(res) {
+    return res;
+  }
+  return x->pos < y->pos ? -1 : 1;
+}
+
 //输出简单节点
-static const char* print_simple_node(const Cjson* out) {
+static bool print_simple_node(const Cjson* out, printbuffer_t* p) {
   static nodetype_t allowTypes[] = { NodeType_TRUE, NodeType_FALSE, NodeType_NULL};
   bool nodeTypeFlag = false;
   for(int i = 0; i < 3; i++) {
@@ -462,316 +4675,391 @@ static const char* print_simple_node(const Cjson* out) {
     }
   }
   if(nodeTypeFlag == false) {
-    printf("type error in print_simple_node method\n");
-    exit(1);
+    return false;
   }
-  char* res;
-  res = cjson_strcopy(out->value.complex);
-  return res;
+  const char* literal = out->nodeType == NodeType_TRUE ? "true" :
+    out->nodeType == NodeType_FALSE ? "false" : "null";
+  return print_bytes(p, literal, strlen(literal));
 }
 
-//复制字符串
-static char* cjson_strcopy(const char* src){
-  if(!src) {
-    printf("error in cjson strcopy, src need be a string\n");
-    exit(1);
+//输出string，键名和string节点共用
+//不需要转义的ascii整段复制；非ascii字符先检查utf-8，只输出ascii时写成\uXXXX，BMP以外的写成代理对，
+//否则原样复制；不合法的utf-8换成U+FFFD，输出总是合法的json
+static bool print_string(const char* str, printbuffer_t* p) {
+  static const char controlEscape[] = "uuuuuuuubtnufruuuuuuuuuuuuuuuuuu"; //控制字符转义后的字母，u表示\u00XX
+  const unsigned char* ptr = (const unsigned char*)(str ? str : "");
+  if(!print_char(p, '\"')) {
+    return false;
   }
-  int len = strlen(src);
-  char* res = (char*)malloc(len);
-  res = strcpy(res, src);
-  return res;
-}
-
-//输出string节点
-static const char* print_string(const Cjson* out) {
-  if(out->nodeType != NodeType_STRING) {
-    printf("type error in print_String\n");
-    exit(1);
-  }
-  const char* ptr = out->value.complex;
-  int len = 0, curLen = 80; //curlen记录现在res长度
-  char* res; 
-  char* resStart = (char*)cjson_malloc(curLen);
-  res = resStart;
-  memset(res, 0, curLen);
-  *res++ = '\"';
-  len++;
-  while(*ptr != '\0') {
-    if(*ptr >= 32 && *ptr != '\"' && *ptr != '\\') {
-      *res++ = *ptr++;
-      len++;
-    } else {
-      len += 2;
-      *res++ = '\\';
-      switch(*ptr) {
-        case '\"':
-        case '/':
-        case '\\':
-          *res++ = *ptr;
-          break;
-        case '\b':
-          *res++ = 'b';
-          break;
-        case '\f':
-          *res++ = 'f';
-          break;
-        case '\n':
-          *res++ = 'n';
-          break;
-        case '\r':
-          *res++ = 'r';
-          break;
-        case '\t':
-          *res++ = 't';
-          break;
-        default:
-          *res++ = 'u';
-          ptr = print_unicode(ptr, res);    //将utf-8转化为utf-16
-          --ptr;
-          while(*res >= 48 && *res <= 57 ||  //跳过unicode的几个字符
-          *res >= 65 && *res <= 70 ||
-          *res >= 97 && *res <= 102) {
-            res++;
-            len++;
-          }
+  for(;;) {
+    const unsigned char* run = ptr;
+    ptr = (const unsigned char*)find_escape((const char*)ptr);
+    if(ptr != run && !print_bytes(p, (const char*)run, ptr - run)) {
+      return false;
+    }
+    unsigned char c = *ptr;
+    if(c == '\0') {
+      break;
+    }
+    if(c < 0x80) { //引号，反斜杠，控制字符
+      char* res = ensure(p, 6);
+      if(!res) {
+        return false;
       }
-      ++ptr;
+      if(c < 32 && controlEscape[c] == 'u') {
+        print_hex4(res, c);
+        p->offset += 6;
+      } else {
+        res[0] = '\\';
+        res[1] = c < 32 ? controlEscape[c] : (char)c;
+        p->offset += 2;
+      }
+      ptr++;
+      continue;
+    }
+    uint32_t code;
+    int len = utf8_decode(ptr, &code);
+    if(!p->asciiOnly && len > 0) { //连续的合法utf-8字符一起复制
+      run = ptr;
+      do {
+        ptr += len;
+      } while(*ptr >= 0x80 && (len = utf8_decode(ptr, &code)) > 0);
+      if(!print_bytes(p, (const char*)run, ptr - run)) {
+        return false;
+      }
+      continue;
     }
-    if(len >= curLen) {
-      while(curLen <= len)
-        curLen *= 2;
-      char* tmpRes = (char*)realloc(res, curLen);
-      if(tmpRes = NULL) {
-        cjson_free(resStart);
-        printf("realloc error in print_string\n");
-        exit(1);
+    ptr += len > 0 ? len : -len;
+    if(!p->asciiOnly) {
+      if(!print_bytes(p, "\xef\xbf\xbd", 3)) { //U+FFFD
+        return false;
       }
-      resStart = tmpRes;
-      res = resStart + curLen - 80;
+      continue;
+    }
+    char* res = ensure(p, 12);
+    if(!res) {
+      return false;
+    }
+    if(code >= 0x10000) { //utf-16代理对
+      code -= 0x10000;
+      print_hex4(res, 0xd800 | code >> 10);
+      print_hex4(res + 6, 0xdc00 | (code & 0x3ff));
+      p->offset += 12;
+    } else {
+      print_hex4(res, code);
+      p->offset += 6;
     }
   }
-  *res++ = '\"';
-  *res++ = '\0';
-  len += 2;
-  char* tmpRes = (char*) realloc(resStart, len);
-  if(tmpRes == NULL) {
-    cjson_free(resStart);
-    printf("realloc error in print_string\n");
-    exit(1);
+  return print_char(p, '\"');
+}
+
+//解码一个utf-8字符，返回用掉的字节数；不合法时code为U+FFFD，返回要跳过的字节数的相反数，
+//跳过的是最长的合法前缀，至少一个字节；过长的编码，代理区和超过U+10FFFF的都不合法
+static int utf8_decode(const unsigned char* str, uint32_t* code) {
+  unsigned char c = str[0], low = 0x80, high = 0xbf;
+  uint32_t value;
+  int need;
+  if(c >= 0xc2 && c <= 0xdf) {
+    need = 1;
+    value = c & 0x1f;
+  } else if(c >= 0xe0 && c <= 0xef) {
+    need = 2;
+    value = c & 0x0f;
+    low = c == 0xe0 ? 0xa0 : 0x80;
+    high = c == 0xed ? 0x9f : 0xbf;
+  } else if(c >= 0xf0 && c <= 0xf4) {
+    need = 3;
+    value = c & 0x07;
+    low = c == 0xf0 ? 0x90 : 0x80;
+    high = c == 0xf4 ? 0x8f : 0xbf;
+  } else {
+    *code = 0xfffd;
+    return -1;
+  }
+  for(int i = 1; i <= need; i++) {
+    if(str[i] < low || str[i] > high) { //结尾的\0也在这里停下
+      *code = 0xfffd;
+      return -i;
+    }
+    value = value << 6 | (str[i] & 0x3f);
+    low = 0x80;
+    high = 0xbf;
   }
-  return tmpRes;
+  *code = value;
+  return need + 1;
 }
 
-//输出unicode
-static const char* print_unicode(const char* str, char* des) {
-  const char* ptr = str;
-  int size;
-  unsigned int firstChar = (unsigned int) *ptr & 0xff, 
-    unicode = 0;
-  if(firstChar <= 0x7f && firstChar >= 0) {
-    size = 1;
-  } else if (firstChar >= 0xc0 && firstChar <= 0xdf) {
-    size = 2;
-  } else if (firstChar >= 0xe0 && firstChar <= 0xef) {
-    size = 3;
-  } else if (firstChar >= 0xf0 && firstChar <= 0xf7) {
-    size =  4;
+//输出\uXXXX，查表得到十六进制数字
+static void print_hex4(char* out, uint32_t code) {
+  static const char hexDigits[] = "0123456789abcdef";
+  out[0] = '\\';
+  out[1] = 'u';
+  out[2] = hexDigits[code >> 12 & 0xf];
+  out[3] = hexDigits[code >> 8 & 0xf];
+  out[4] = hexDigits[code >> 4 & 0xf];
+  out[5] = hexDigits[code & 0xf];
+}
+
+//grisu2用的浮点数，值为f * 2^e
+typedef struct {
+  uint64_t f;
+  int e;
+} diyfp_t;
+
+//10^-348到10^340，每隔8个取一个，64位尾数
+static const diyfp_t cached_powers[] = {
+    {0xfa8fd5a0081c0288ULL, -1220}, {0xbaaee17fa23ebf76ULL, -1193}, {0x8b16fb203055ac76ULL, -1166},
+    {0xcf42894a5dce35eaULL, -1140}, {0x9a6bb0aa55653b2dULL, -1113}, {0xe61acf033d1a45dfULL, -1087},
+    {0xab70fe17c79ac6caULL, -1060}, {0xff77b1fcbebcdc4fULL, -1034}, {0xbe5691ef416bd60cULL, -1007},
+    {0x8dd01fad907ffc3cULL, -980}, {0xd3515c2831559a83ULL, -954}, {0x9d71ac8fada6c9b5ULL, -927},
+    {0xea9c227723ee8bcbULL, -901}, {0xaecc49914078536dULL, -874}, {0x823c12795db6ce57ULL, -847},
+    {0xc21094364dfb5637ULL, -821}, {0x9096ea6f3848984fULL, -794}, {0xd77485cb25823ac7ULL, -768},
+    {0xa086cfcd97bf97f4ULL, -741}, {0xef340a98172aace5ULL, -715}, {0xb23867fb2a35b28eULL, -688},
+    {0x84c8d4dfd2c63f3bULL, -661}, {0xc5dd44271ad3cdbaULL, -635}, {0x936b9fcebb25c996ULL, -608},
+    {0xdbac6c247d62a584ULL, -582}, {0xa3ab66580d5fdaf6ULL, -555}, {0xf3e2f893dec3f126ULL, -529},
+    {0xb5b5ada8aaff80b8ULL, -502}, {0x87625f056c7c4a8bULL, -475}, {0xc9bcff6034c13053ULL, -449},
+    {0x964e858c91ba2655ULL, -422}, {0xdff9772470297ebdULL, -396}, {0xa6dfbd9fb8e5b88fULL, -369},
+    {0xf8a95fcf88747d94ULL, -343}, {0xb94470938fa89bcfULL, -316}, {0x8a08f0f8bf0f156bULL, -289},
+    {0xcdb02555653131b6ULL, -263}, {0x993fe2c6d07b7facULL, -236}, {0xe45c10c42a2b3b06ULL, -210},
+    {0xaa242499697392d3ULL, -183}, {0xfd87b5f28300ca0eULL, -157}, {0xbce5086492111aebULL, -130},
+    {0x8cbccc096f5088ccULL, -103}, {0xd1b71758e219652cULL, -77}, {0x9c40000000000000ULL, -50},
+    {0xe8d4a51000000000ULL, -24}, {0xad78ebc5ac620000ULL, 3}, {0x813f3978f8940984ULL, 30},
+    {0xc097ce7bc90715b3ULL, 56}, {0x8f7e32ce7bea5c70ULL, 83}, {0xd5d238a4abe98068ULL, 109},
+    {0x9f4f2726179a2245ULL, 136}, {0xed63a231d4c4fb27ULL, 162}, {0xb0de65388cc8ada8ULL, 189},
+    {0x83c7088e1aab65dbULL, 216}, {0xc45d1df942711d9aULL, 242}, {0x924d692ca61be758ULL, 269},
+    {0xda01ee641a708deaULL, 295}, {0xa26da3999aef774aULL, 322}, {0xf209787bb47d6b85ULL, 348},
+    {0xb454e4a179dd1877ULL, 375}, {0x865b86925b9bc5c2ULL, 402}, {0xc83553c5c8965d3dULL, 428},
+    {0x952ab45cfa97a0b3ULL, 455}, {0xde469fbd99a05fe3ULL, 481}, {0xa59bc234db398c25ULL, 508},
+    {0xf6c69a72a3989f5cULL, 534}, {0xb7dcbf5354e9beceULL, 561}, {0x88fcf317f22241e2ULL, 588},
+    {0xcc20ce9bd35c78a5ULL, 614}, {0x98165af37b2153dfULL, 641}, {0xe2a0b5dc971f303aULL, 667},
+    {0xa8d9d1535ce3b396ULL, 694}, {0xfb9b7cd9a4a7443cULL, 720}, {0xbb764c4ca7a44410ULL, 747},
+    {0x8bab8eefb6409c1aULL, 774}, {0xd01fef10a657842cULL, 800}, {0x9b10a4e5e9913129ULL, 827},
+    {0xe7109bfba19c0c9dULL, 853}, {0xac2820d9623bf429ULL, 880}, {0x80444b5e7aa7cf85ULL, 907},
+    {0xbf21e44003acdd2dULL, 933}, {0x8e679c2f5e44ff8fULL, 960}, {0xd433179d9c8cb841ULL, 986},
+    {0x9e19db92b4e31ba9ULL, 1013}, {0xeb96bf6ebadf77d9ULL, 1039}, {0xaf87023b9bf0ee6bULL, 1066},
+};
+
+static const char digit_pairs[] = //两位一组输出整数
+  "00010203040506070809101112131415161718192021222324252627282930313233343536373839"
+  "40414243444546474849505152535455565758596061626364656667686970717273747576777879"
+  "8081828384858687888990919293949596979899";
+
+static diyfp_t diyfp_from_double(double d) {
+  diyfp_t res;
+  uint64_t u;
+  memcpy(&u, &d, sizeof(u));
+  int biased = (int)((u >> 52) & 0x7ff);
+  uint64_t significand = u & 0x000fffffffffffffULL;
+  if(biased) {
+    res.f = significand + 0x0010000000000000ULL;
+    res.e = biased - 1075;
   } else {
-    printf("invalid unicode in print_unicode\n");
-    exit(1);
+    res.f = significand;
+    res.e = 1 - 1075;
   }
-  if(size == 1) {
-    unicode = (unsigned int) *ptr++ & 0xff & 0xff;
+  return res;
+}
+
+//两个64位尾数相乘，保留高64位并四舍五入
+static diyfp_t diyfp_mul(diyfp_t x, diyfp_t y) {
+  const uint64_t M32 = 0xffffffffULL;
+  uint64_t a = x.f >> 32, b = x.f & M32, c = y.f >> 32, d = y.f & M32;
+  uint64_t ac = a * c, bc = b * c, ad = a * d, bd = b * d;
+  uint64_t tmp = (bd >> 32) + (ad & M32) + (bc & M32);
+  tmp += 1U << 31;
+  diyfp_t res;
+  res.f = ac + (ad >> 32) + (bc >> 32) + (tmp >> 32);
+  res.e = x.e + y.e + 64;
+  return res;
+}
+
+static diyfp_t diyfp_normalize(diyfp_t x) {
+  int shift = __builtin_clzll(x.f);
+  x.f <<= shift;
+  x.e -= shift;
+  return x;
+}
+
+//计算能舍入到同一个double的上下边界
+static void diyfp_boundaries(double d, diyfp_t* minus, diyfp_t* plus) {
+  diyfp_t v = diyfp_from_double(d), pl, mi;
+  pl.f = (v.f << 1) + 1;
+  pl.e = v.e - 1;
+  pl = diyfp_normalize(pl);
+  if(v.f == 0x0010000000000000ULL) { //2的整数次幂下边界更近
+    mi.f = (v.f << 2) - 1;
+    mi.e = v.e - 2;
   } else {
-    if(size == 4) {
-      unicode = (unsigned int) *ptr++ & 0xff & 0x1f;
-    } else if (size == 3) {
-      unicode = (unsigned int) *ptr++ & 0xff & 0x0f;
-    } else {
-      unicode = (unsigned int) *ptr++ & 0xff & 0x07;  
-    }
-    unicode <<= 6;
-    
-    int time = size - 1;
-    while (time--) {
-      unicode += (unsigned int) *ptr++ & 0xff & 0x3f;
-      time && (unicode <<= 6);
-    }
-  }  
-  //得到unicode，转化为utf-16
-  int printInLen = sprintf(des, "%04x", unicode);
-  return ptr;
+    mi.f = (v.f << 1) - 1;
+    mi.e = v.e - 1;
+  }
+  mi.f <<= mi.e - pl.e;
+  mi.e = pl.e;
+  *minus = mi;
+  *plus = pl;
 }
 
-//输出数字
-static const char* print_number(const Cjson* out) {
-  if(out->nodeType != NodeType_NUMBER) {
-    printf("type error in print_number method\n");
-    exit(1);
+static void grisu_round(char* buffer, int len, uint64_t delta, uint64_t rest, uint64_t tenKappa, uint64_t wpw) {
+  while(rest < wpw && delta - rest >= tenKappa &&
+    (rest + tenKappa < wpw || wpw - rest > rest + tenKappa - wpw)) {
+    buffer[len - 1]--;
+    rest += tenKappa;
   }
-  char* res = (char*) malloc(80);
-  int len = 0;
-  if(!res) {
-    printf("malloc error in print_number method\n");
-    exit(1);
+}
+
+//生成十进制数字，K是10的指数
+static int grisu_digits(diyfp_t w, diyfp_t mp, uint64_t delta, char* buffer, int* K) {
+  static const uint64_t pow10[] = {1ULL, 10ULL, 100ULL, 1000ULL, 10000ULL, 100000ULL, 1000000ULL, 10000000ULL,
+    100000000ULL, 1000000000ULL, 10000000000ULL, 100000000000ULL, 1000000000000ULL, 10000000000000ULL,
+    100000000000000ULL, 1000000000000000ULL, 10000000000000000ULL, 100000000000000000ULL,
+    1000000000000000000ULL, 10000000000000000000ULL}; //小数部分最多生成到10^-19，都要能取整
+  diyfp_t one;
+  one.f = (uint64_t)1 << -mp.e;
+  one.e = mp.e;
+  uint64_t wpw = mp.f - w.f;
+  uint32_t p1 = (uint32_t)(mp.f >> -one.e);
+  uint64_t p2 = mp.f & (one.f - 1);
+  int kappa = 1, len = 0;
+  while(kappa < 10 && p1 >= pow10[kappa])
+    kappa++;
+  while(kappa > 0) {
+    uint32_t d = (uint32_t)(p1 / pow10[kappa - 1]);
+    p1 %= (uint32_t)pow10[kappa - 1];
+    if(d || len)
+      buffer[len++] = (char)('0' + d);
+    kappa--;
+    uint64_t tmp = ((uint64_t)p1 << -one.e) + p2;
+    if(tmp <= delta) {
+      *K += kappa;
+      grisu_round(buffer, len, delta, tmp, pow10[kappa] << -one.e, wpw);
+      return len;
+    }
   }
-  if(out -> isInt) {
-    len = sprintf(res, "%d", out->value.intNum);
+  for(;;) {
+    p2 *= 10;
+    delta *= 10;
+    char d = (char)(p2 >> -one.e);
+    if(d || len)
+      buffer[len++] = (char)('0' + d);
+    p2 &= one.f - 1;
+    kappa--;
+    if(p2 < delta) {
+      *K += kappa;
+      grisu_round(buffer, len, delta, p2, one.f, -kappa < 20 ? wpw * pow10[-kappa] : 0);
+      return len;
+    }
+  }
+}
+
+//grisu2，输出能精确还原的最短数字（极少数情况下多一位），返回位数
+static int grisu2(double value, char* buffer, int* K) {
+  diyfp_t minus, plus, v = diyfp_normalize(diyfp_from_double(value));
+  diyfp_boundaries(value, &minus, &plus);
+  double dk = (-61 - plus.e) * 0.30102999566398114 + 347; //选一个10的幂，让乘积的指数落在[-60, -32]
+  int k = (int)dk;
+  if(dk - k > 0.0)
+    k++;
+  unsigned index = (unsigned)((k >> 3) + 1);
+  diyfp_t c = cached_powers[index];
+  *K = -(-348 + (int)index * 8);
+  diyfp_t w = diyfp_mul(v, c), wp = diyfp_mul(plus, c), wm = diyfp_mul(minus, c);
+  wm.f++;
+  wp.f--;
+  return grisu_digits(w, wp, wp.f - wm.f, buffer, K);
+}
+
+//输出64位整数，两位一组从后往前写，返回长度
+static int write_int64(int64_t num, char* out) {
+  uint64_t u = num < 0 ? 0 - (uint64_t)num : (uint64_t)num;
+  int len = 1;
+  for(uint64_t t = u; t >= 10; t /= 10)
+    len++;
+  if(num < 0)
+    *out++ = '-';
+  char* ptr = out + len;
+  while(u >= 100) {
+    unsigned i = (unsigned)(u % 100) * 2;
+    u /= 100;
+    *--ptr = digit_pairs[i + 1];
+    *--ptr = digit_pairs[i];
+  }
+  if(u >= 10) {
+    *--ptr = digit_pairs[u * 2 + 1];
+    *--ptr = digit_pairs[u * 2];
   } else {
-    len = sprintf(res, "%e", out->value.doubleNum);
+    *--ptr = (char)('0' + u);
+  }
+  return len + (num < 0);
+}
+
+//输出double，最短能还原的数字，整数值补上.0，这样重新解析还是小数
+static int write_double(double num, char* out) {
+  char* start = out;
+  if(num != num || num - num != 0) { //nan和inf在json里没有表示
+    memcpy(out, "null", 4);
+    return 4;
   }
-  char* tmpRes = (char*)realloc(res, len + 1);
-  if(!tmpRes) {
-    printf("realloc error in print_number function \n");
-    free(tmpRes);
-    exit(1);
+  if(signbit(num)) {
+    *out++ = '-';
+    num = -num;
   }
-  res = tmpRes;
-  return res;
+  if(num == 0) {
+    memcpy(out, "0.0", 3);
+    return (int)(out - start) + 3;
+  }
+  char digits[24];
+  int K, len = grisu2(num, digits, &K),
+    point = len + K; //小数点在第几位数字后面
+  if(K >= 0 && point <= 21) { //整数，补0再加.0
+    memcpy(out, digits, len);
+    memset(out + len, '0', K);
+    out += point;
+    memcpy(out, ".0", 2);
+    out += 2;
+  } else if(point > 0 && point <= 21) {
+    memcpy(out, digits, point);
+    out[point] = '.';
+    memcpy(out + point + 1, digits + point, len - point);
+    out += len + 1;
+  } else if(point > -6 && point <= 0) {
+    *out++ = '0';
+    *out++ = '.';
+    memset(out, '0', -point);
+    out += -point;
+    memcpy(out, digits, len);
+    out += len;
+  } else { //科学计数法
+    *out++ = digits[0];
+    if(len > 1) {
+      *out++ = '.';
+      memcpy(out, digits + 1, len - 1);
+      out += len - 1;
+    }
+    *out++ = 'e';
+    int exp10 = point - 1;
+    if(exp10 < 0) {
+      *out++ = '-';
+      exp10 = -exp10;
+    }
+    out += write_int64(exp10, out);
+  }
+  return (int)(out - start);
 }
 
-//输出array 的json
-static const char* print_array(const Cjson* out) {
-  int curLen = 80, len = 0;
-  char* res = (char*)cjson_malloc(curLen),
-    *subRes,
-    *resStart;
-  resStart = res;
-  Cjson* curCjson = out->child;
-  if(!curCjson) {
-    return NULL;
+//输出数字，直接写到输出缓冲区里
+static bool print_number(const Cjson* out, printbuffer_t* p) {
+  if(out->nodeType != NodeType_NUMBER) {
+    return false;
   }
+  char* res = ensure(p, 32); //最长的double是-d.dddddddddddddddde-ddd
   if(!res) {
-    printf("error in print_array method \n");
-    cjson_free(res);
-    exit(1);
-  }
-  *res++ = '[';
-  len++;
-  while(curCjson && curCjson->nodeType && curCjson->nodeType != NOTYPE) {
-    subRes = (char*)print_json(curCjson);
-    int tmpLen = strlen(subRes);
-    len += tmpLen + 1;
-    if(len >= curLen) {
-      while(curLen <= len)
-        curLen *= 2;
-      char* tmpc = (char*)realloc(resStart, curLen);
-      if(!tmpc) {
-        printf("Error in realloc in print_array function");
-        exit(1);
-      }
-      resStart = tmpc;
-      res = resStart + len - tmpLen - 2;
-    }
-    if(sprintf(res, "%s", subRes) != tmpLen ) {
-      printf("error in sprintf in print_array method");
-      cjson_free(res);
-      cjson_free((char*)subRes);
-      exit(1);
-    }
-    cjson_free(subRes);
-    res += tmpLen;
-    *res++ = ',';
-    curCjson = curCjson->next;
-  }
-  *(--res) = ']';
-  ++res;
-  *res++ = '\0';
-  len += 2;
-  char* tmpOne = (char*)realloc(resStart, len);
-  if(!tmpOne) {
-    printf("error in sprintf in print_array method");
-    cjson_free(resStart);
-    exit(1);
-  }
-  return tmpOne;
-}
-
-//输出object的json
-static const char* print_object(const Cjson* out) {
-  if(out->nodeType != NodeType_OBJECT) {
-    printf("error in print_object method/n");
-    exit(1);
-  }
-  int curLen = 80, len = 0;
-  char* res = (char*)cjson_malloc(curLen),
-    *subRes,
-    *resStart;
-  resStart = res;
-  Cjson* curCjson = out->child;
-  if(!curCjson) {
-    return NULL;
+    return false;
   }
-  if(!res) {
-    printf("error in print_array method \n");
-    cjson_free(res);
-    exit(1);
-  }
-  *res++ = '{';
-  len++;
-  while(curCjson && curCjson->nodeType
-   && curCjson->nodeType != NOTYPE) {
-     char *keyName, *value; //处理键
-     int nameLen, valueLen;
-     keyName = (char *)curCjson->keyName;
-     if(!keyName) {
-       printf("error in print_object, no keyName\n");
-       exit(1);
-     }
-     nameLen = strlen(keyName);
-     len += nameLen + 4; // 加上了逗号与冒号,引号
-     if(len >= curLen) {
-      while(curLen <= len)
-        curLen *= 2;
-      char* tmpc = (char*)realloc(resStart, curLen);
-      if(!tmpc) {
-        printf("Error in realloc in print_object function");
-        exit(1);
-      }
-      resStart = tmpc;
-      res = resStart + len - nameLen - 5;
-    }
-    *res++ = '\"';
-    if(sprintf(res, "%s", keyName) != nameLen) {
-      printf("error in sprintf in print_object\n");
-      exit(1);
-    }
-    res += nameLen;
-    *res++ = '\"';
-    *res++ = ':';
-    value = (char *)print_json(curCjson); //处理值
-    valueLen = strlen(value);
-    len += valueLen;
-    if(len >= curLen) {
-      while(curLen <= len)
-        curLen *= 2;
-      char* tmpc = (char*)realloc(resStart, curLen);
-      if(!tmpc) {
-        printf("Error in realloc in print_object function");
-        exit(1);
-      }
-      resStart = tmpc;
-      res = resStart + len - valueLen - 1;
-    }
-    if(sprintf(res, "%s", value) != valueLen) {
-      printf("error in sprintf in print_object\n");
-      exit(1);
-    }
-    res += valueLen;
-    *res++ = ',';
-    cjson_free(value);
-    value = NULL;
-    curCjson = curCjson->next;
-  }
-  *(--res) = '}';
-  ++res;
-  *res++ = '\0';
-  len += 2;
-  char* tmpOne = (char*)realloc(resStart, len);
-  if(!tmpOne) {
-    printf("error in sprintf in print_object method");
-    cjson_free(resStart);
-    exit(1);
-  }
-  return tmpOne;
-}
\ No newline at end of file
+  if(out -> isInt) {
+    p->offset += write_int64(out->value.intNum, res);
+  } else {
+    p->offset += write_double(out->value.doubleNum, res);
+  }
+  return true;
+}
+
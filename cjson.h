@@ -13,6 +13,8 @@
 #include <float.h>
 #include <math.h>
 #include <limits.h>
+#include <stdint.h>
+#include <locale.h>
 
 //标志节点类型
 typedef enum NodeType {     
@@ -26,38 +28,273 @@ typedef enum NodeType {
   NOTYPE = 0
 } nodetype_t;
 
+#ifndef CJSON_NESTING_LIMIT
+#define CJSON_NESTING_LIMIT 1000 //默认最大嵌套层数，可以用cjson_set_max_depth修改
+#endif
+#ifndef CJSON_INDEX_MIN_MEMBERS
+#define CJSON_INDEX_MIN_MEMBERS 8 //成员达到这个数量时cjson_get建哈希索引，更少时逐个比较
+#endif
+#ifndef CJSON_INDEX_EAGER_MEMBERS
+#define CJSON_INDEX_EAGER_MEMBERS 128 //解析时成员达到这个数量的object直接建索引，0表示不建
+#endif
+#ifndef CJSON_VECTOR_MIN_ITEMS
+#define CJSON_VECTOR_MIN_ITEMS 8 //元素达到这个数量时cjson_array_get建元素数组，更少时逐个走
+#endif
+#ifndef CJSON_VECTOR_EAGER_ITEMS
+#define CJSON_VECTOR_EAGER_ITEMS 0 //解析时元素达到这个数量的array直接建元素数组，0表示不建
+#endif
+
+typedef struct _cjson_index cjson_index_t; //object的键名索引
+typedef struct _cjson_vector cjson_vector_t; //array的元素数组
+
 //记录数据
 typedef union DataValue{
-  int intNum;
+  int64_t intNum; //整数，按64位存
   double doubleNum;
   char* complex;
+  cjson_index_t* index; //object的键名索引，用到时才建
+  cjson_vector_t* vector; //array的元素数组，用到时才建
 } datavalue_t;
 
-//json节点类型
+//json节点类型，定义CJSON_SINGLY_LINKED可以去掉prev，节点再小8个字节
 typedef struct _cjson{
-  struct _cjson *prev, *next;
+  struct _cjson *next;
+#ifndef CJSON_SINGLY_LINKED
+  struct _cjson *prev;
+#endif
   struct _cjson *child;
 
-  nodetype_t nodeType; //节点类型 
-  datavalue_t value;  //值
-  bool isReference; //是否是引用
+  datavalue_t value;  //值，null，true，false不占用
   char *keyName; //建值
-  bool isInt; //表示是不是整数
+  unsigned char nodeType; //节点类型，取nodetype_t的值
+  bool isReference : 1; //是否是引用
+  bool isInt : 1; //表示是不是整数
+  bool inArena : 1; //节点分配在arena里，不能单独释放
+  bool inlineData : 1; //键名和字符串值跟节点在同一块内存里
+  bool sharedKey : 1; //键名在键名表里，多个节点共用
+  bool borrowed : 1; //键名和字符串指向原地解析的输入缓冲区，不释放
+  bool indexed; //在某个object的键名索引或者array的元素数组里，单独一个字节，查找时建索引用原子操作写
 } Cjson;
 
+//字符串和空白扫描用的指令集
+typedef enum {
+  CJSON_SCAN_AUTO = 0, //运行时按cpu选择
+  CJSON_SCAN_SCALAR, //逐字节
+  CJSON_SCAN_SSE2,
+  CJSON_SCAN_AVX2
+} cjson_scan_mode_t;
+
 typedef struct {
   void* (*malloc_fn) (size_t size);
   void (*free_fn) (void *);
 } NewHook;
 
-extern void new_hook(NewHook *hook); //初始化allocator
+//内存上下文：自己的allocator和解析用的临时空间，每个线程用自己的上下文时不用共享全局的allocator
+//同一个上下文不能同时在多个线程里用；用上下文创建的节点要用同一个上下文释放
+typedef struct {
+  void* (*malloc_fn) (size_t size);
+  void (*free_fn) (void *);
+  char* scratch; //解码长键名的临时空间，留给下次解析
+  size_t scratchLen;
+} CjsonContext;
+
+#ifndef CJSON_PARALLEL_MIN_CHUNK
+#define CJSON_PARALLEL_MIN_CHUNK 262144 //多线程解析时每个线程至少分到的字节数
+#endif
+
+#ifndef CJSON_PRINT_CHUNK
+#define CJSON_PRINT_CHUNK 16384 //流式输出时每次交给写函数的最多字节数
+#endif
+
+//输出选项，全0时紧凑输出，成员按原来的顺序，非ascii字符原样输出
+typedef struct {
+  int indent; //缩进的空格数，0表示紧凑输出
+  bool sortKeys; //object的成员按键名排序输出
+  bool asciiOnly; //非ascii字符输出成\uXXXX，BMP以外的用代理对；否则检查过的utf-8原样输出
+} CjsonPrintOptions;
+
+//流式输出的写函数，data只在调用时有效，返回false停止输出
+typedef bool (*cjson_write_fn)(void* userdata, const char* data, size_t len);
+
+#ifndef CJSON_ARENA_BLOCK_SIZE
+#define CJSON_ARENA_BLOCK_SIZE 65536 //arena默认块大小
+#endif
+
+//arena里的一块连续内存，数据紧跟在块头后面
+typedef struct _cjson_arena_block {
+  struct _cjson_arena_block* next;
+  size_t size; //块容量
+  size_t used; //已经使用的字节
+} CjsonArenaBlock;
+
+//arena，整棵树的节点和字符串都放在若干大块里，一次释放
+typedef struct {
+  CjsonArenaBlock* head;
+  size_t blockSize;
+  void* (*malloc_fn) (size_t size); //创建时的allocator，来自new_hook
+  void (*free_fn) (void *);
+} CjsonArena;
+
+//键名表，同样的键名只存一份，表里的键名不可修改；不能在多个线程里同时用同一张表解析
+typedef struct _cjson_key_table CjsonKeyTable;
+
+//SAX事件回调，userdata是调用者传进来的参数，返回false停止解析，不关心的事件可以为NULL
+typedef struct {
+  bool (*null_value)(void* userdata);
+  bool (*boolean)(void* userdata, bool value);
+  bool (*integer)(void* userdata, int64_t value); //为NULL时整数也交给number
+  bool (*number)(void* userdata, double value);
+  bool (*string)(void* userdata, const char* str, size_t len); //str只在回调里有效
+  bool (*key)(void* userdata, const char* key, size_t len); //key只在回调里有效
+  bool (*start_object)(void* userdata);
+  bool (*end_object)(void* userdata);
+  bool (*start_array)(void* userdata);
+  bool (*end_array)(void* userdata);
+} CjsonSaxHandler;
+
+//流式解析器，输入可以分成任意多块送进来
+typedef struct _cjson_parser CjsonParser;
+
+//映射到内存的json文件和从它原地解析出来的树
+typedef struct _cjson_file CjsonFile;
+
+//懒解析的结构索引，记下括号，冒号，逗号和字符串的位置
+typedef struct _cjson_lazy CjsonLazy;
+
+//解析失败的原因和位置，行和列从1开始，列按字节算
+typedef struct {
+  size_t offset; //出错位置离输入开头的字节数
+  size_t line;
+  size_t column;
+  const char* reason; //静态字符串，不用释放，解析成功时为NULL
+} CjsonError;
+
+//压成一块连续内存的只读json，见cjson_tape_freeze
+typedef struct _cjson_tape CjsonTape;
+
+//tape里的一个值，只是一个下标，不分配内存
+typedef struct {
+  const CjsonTape* tape; //为NULL表示值不存在
+  uint32_t index; //值在tape里的下标，tape最多2^32个字
+  uint32_t key; //object成员的键名在tape里的下标，不是object成员时为0
+} CjsonTapeValue;
+
+//编译好的查询路径，见cjson_query_compile
+typedef struct _cjson_query CjsonQuery;
+
+#ifndef CJSON_QUERY_MAX_STEPS
+#define CJSON_QUERY_MAX_STEPS 64 //查询路径最多的步数，跑查询时的回溯栈放在调用者的栈上
+#endif
+
+//懒解析里的一个值，只是一个位置，不分配内存
+typedef struct {
+  const CjsonLazy* doc;
+  const char* ptr; //值在json里开始的位置，为NULL表示值不存在
+  uint32_t index; //object，array，string是它自己在索引里的下标，其他值是后面的逗号或右括号的下标
+} CjsonLazyValue;
+
+extern void new_hook(NewHook *hook); //更改默认的allocator，要在其他线程开始解析之前调用
+extern void cjson_context_init(CjsonContext* mem, const NewHook* hook); //初始化上下文，hook为NULL时用malloc和free
+extern void cjson_context_release(CjsonContext* mem); //释放上下文保留的临时空间
+extern void cjson_set_scan_mode(cjson_scan_mode_t mode); //选择扫描用的指令集，默认自动选择
+extern CjsonArena* cjson_arena_new(size_t blockSize); //创建arena，blockSize为0时用默认大小
+extern void* cjson_arena_alloc(CjsonArena* arena, size_t size); //从arena分配内存
+extern void cjson_arena_free(CjsonArena* arena); //释放arena和里面的所有节点
+extern CjsonKeyTable* cjson_keytable_new(void); //创建键名表
+extern void cjson_keytable_free(CjsonKeyTable* table); //不再使用键名表，引用它的树删掉后才释放
+extern const char* cjson_keytable_intern(CjsonKeyTable* table, const char* key); //取得表里的键名
 extern Cjson* create_simple_type_node(nodetype_t nodeType, const char * cpString); //添加除了array和object，number外其他节点的数据
 extern Cjson* create_new_node(nodetype_t nodeType); //创建节点
-extern Cjson* cjson_parse(const char *); //解析json函数
+extern Cjson* create_new_node_ctx(CjsonContext* mem, nodetype_t nodeType); //用上下文的allocator创建节点
+extern Cjson* create_simple_type_node_ctx(CjsonContext* mem, nodetype_t nodeType, const char * cpString); //用上下文的allocator创建简单节点
+extern Cjson* cjson_parse(const char *); //解析json函数，出错时返回NULL
+extern Cjson* cjson_parse_err(const char *, CjsonError* err); //出错时返回NULL，错误写到err里
+extern Cjson* cjson_parse_n(const char* buf, size_t len); //按长度解析，buf不需要以\0结尾，不读len后面的字节
+extern Cjson* cjson_parse_n_ctx(CjsonContext* mem, const char* buf, size_t len); //用上下文的allocator按长度解析
+extern const CjsonError* cjson_last_error(void); //当前线程最近一次解析的错误，成功时reason为NULL
+extern Cjson* cjson_parse_ctx(CjsonContext* mem, const char *); //用上下文的allocator解析
+extern Cjson* cjson_parse_arena(const char *, CjsonArena* arena); //解析到arena里
+extern Cjson* cjson_parse_keytable(const char *, CjsonKeyTable* keys); //键名放到键名表里共用
+extern Cjson* cjson_parse_interned(const char *); //同一次解析里相同的键名共用
+extern Cjson* cjson_parse_insitu(char* buf); //原地解析，字符串在buf里解码，节点指向buf
+extern Cjson* cjson_parse_insitu_ctx(CjsonContext* mem, char* buf); //用上下文的allocator原地解析
+extern Cjson* cjson_parse_file(const char* path); //文件映射到内存里解析，不用先读进缓冲区
+extern Cjson* cjson_parse_file_ctx(CjsonContext* mem, const char* path); //用上下文的allocator解析文件
+extern CjsonFile* cjson_file_parse(const char* path); //映射文件后原地解析，字符串指向映射
+extern CjsonFile* cjson_file_parse_ctx(CjsonContext* mem, const char* path); //用上下文的allocator映射文件后原地解析
+extern Cjson* cjson_file_root(const CjsonFile* file); //原地解析出来的树，归CjsonFile所有
+extern void cjson_file_free(CjsonFile* file); //删除树并解除映射
+extern void cjson_set_max_depth(size_t depth); //设置解析的最大嵌套层数，0恢复默认
+extern Cjson* cjson_parse_parallel(const char *, int threads); //顶层array切成几段多线程解析，threads为0时用cpu核数
+extern Cjson* cjson_parse_ndjson(const char *, int threads); //多线程解析ndjson，返回每行的树组成的array
+extern Cjson* cjson_parse_parallel_ctx(CjsonContext* mem, const char *, int threads); //用上下文的allocator多线程解析，allocator要是线程安全的
+extern Cjson* cjson_parse_ndjson_ctx(CjsonContext* mem, const char *, int threads); //用上下文的allocator多线程解析ndjson
+extern bool cjson_parse_sax(const char *, const CjsonSaxHandler* handler, void* userdata); //只发事件不建树，出错或者回调要求停止时返回false
+extern bool cjson_parse_sax_ctx(CjsonContext* mem, const char *, const CjsonSaxHandler* handler, void* userdata); //临时内存用上下文的allocator分配
+extern CjsonParser* cjson_parser_new(void); //创建流式解析器
+extern CjsonParser* cjson_parser_new_ctx(CjsonContext* mem); //用上下文的allocator创建流式解析器，树用deleteCjson_ctx释放
+extern CjsonParser* cjson_parser_new_sax(const CjsonSaxHandler* handler, void* userdata); //创建发SAX事件的流式解析器
+extern CjsonParser* cjson_parser_new_sax_ctx(CjsonContext* mem, const CjsonSaxHandler* handler, void* userdata); //用上下文的allocator创建发SAX事件的流式解析器
+extern bool cjson_parser_feed(CjsonParser* p, const char* buf, size_t len); //送进一块输入，buf不需要以\0结尾，出错时返回false
+extern Cjson* cjson_parser_finish(CjsonParser* p); //输入结束，返回解析好的树，出错时返回NULL
+extern void cjson_parser_free(CjsonParser* p); //释放流式解析器
 extern Cjson* add_next(Cjson* cur, Cjson* next); //添加下个节点
+extern Cjson* cjson_get(const Cjson* obj, const char* key); //按键名查找object的成员，多个线程可以同时查找同一棵不再修改的树，修改和查找不能同时进行
+extern Cjson* cjson_get_interned(const Cjson* obj, const char* key); //key来自键名表，按指针比较
+extern Cjson* cjson_get_ctx(CjsonContext* mem, const Cjson* obj, const char* key); //用上下文创建的树，索引用上下文的allocator建
+extern size_t cjson_array_size(const Cjson* arr); //array的元素个数，有元素数组时是O(1)
+extern Cjson* cjson_array_get(const Cjson* arr, size_t i); //取array的第i个元素，元素多时第一次访问建元素数组，之后是O(1)
+extern Cjson* cjson_array_get_ctx(CjsonContext* mem, const Cjson* arr, size_t i); //用上下文创建的树，元素数组用上下文的allocator建
 extern Cjson* deleteCjson(Cjson* out); //删除Cjson对象
+extern Cjson* deleteCjson_ctx(CjsonContext* mem, Cjson* out); //删除用上下文创建的Cjson对象
+extern CjsonLazy* cjson_lazy_parse(const char* str); //只建结构索引，str要比索引活得久
+extern CjsonLazy* cjson_lazy_parse_ctx(CjsonContext* mem, const char* str); //用上下文的allocator建索引，物化的节点用deleteCjson_ctx释放
+extern void cjson_lazy_free(CjsonLazy* doc); //释放结构索引
+extern CjsonLazyValue cjson_lazy_root(const CjsonLazy* doc); //根节点
+extern nodetype_t cjson_lazy_type(CjsonLazyValue v); //值的类型，不存在时是NOTYPE
+extern CjsonLazyValue cjson_lazy_get(CjsonLazyValue obj, const char* key); //按键名找成员，跳过其他子树
+extern CjsonLazyValue cjson_lazy_at(CjsonLazyValue arr, size_t i); //取array的第i个元素
+extern Cjson* cjson_lazy_materialize(CjsonLazyValue v); //把值和它的子树解析成节点
+extern CjsonTape* cjson_tape_freeze(const Cjson* root); //把树压成一块连续的tape，多个线程可以同时读
+extern CjsonTape* cjson_tape_parse(const char* str); //直接解析成tape，不建节点，出错时返回NULL
+extern CjsonTape* cjson_tape_freeze_ctx(CjsonContext* mem, const Cjson* root); //用上下文的allocator建tape
+extern CjsonTape* cjson_tape_parse_ctx(CjsonContext* mem, const char* str); //用上下文的allocator直接解析成tape
+extern void cjson_tape_free(CjsonTape* tape); //释放tape
+extern CjsonTapeValue cjson_tape_root(const CjsonTape* tape); //根节点
+extern nodetype_t cjson_tape_type(CjsonTapeValue v); //值的类型，不存在时是NOTYPE
+extern size_t cjson_tape_size(CjsonTapeValue v); //array，object的成员数
+extern CjsonTapeValue cjson_tape_first(CjsonTapeValue v); //容器的第一个成员
+extern CjsonTapeValue cjson_tape_next(CjsonTapeValue v); //下一个成员，O(1)跳过子树
+extern const char* cjson_tape_key(CjsonTapeValue v, size_t* len); //object成员的键名
+extern CjsonTapeValue cjson_tape_get(CjsonTapeValue obj, const char* key); //按键名找成员
+extern CjsonTapeValue cjson_tape_at(CjsonTapeValue arr, size_t i); //取array的第i个元素
+extern const char* cjson_tape_string(CjsonTapeValue v, size_t* len); //字符串的内容，不是字符串时返回NULL
+extern double cjson_tape_number(CjsonTapeValue v); //数字的值
+extern bool cjson_tape_int(CjsonTapeValue v, int64_t* out); //是整数时取出来
+extern CjsonQuery* cjson_query_compile(const char* path); //编译"/a/0/b"这样的JSON Pointer或者"a[0].b"，"[*].City"这样的路径，不合法时返回NULL
+extern void cjson_query_free(CjsonQuery* q); //释放编译好的查询
+extern Cjson* cjson_query_first(const CjsonQuery* q, const Cjson* root); //第一个匹配的节点，不分配内存，没有建过索引时逐个找
+extern size_t cjson_query_all(const CjsonQuery* q, const Cjson* root, Cjson** out, size_t cap); //匹配的节点放到out里，最多cap个，返回匹配的总数，不分配内存
+extern Cjson* cjson_query_parse(const CjsonQuery* q, const char* json); //只解析匹配的值，返回它们组成的array，其他子树跳过
+extern CjsonQuery* cjson_query_compile_ctx(CjsonContext* mem, const char* path); //用上下文的allocator编译查询
+extern Cjson* cjson_query_parse_ctx(CjsonContext* mem, const CjsonQuery* q, const char* json); //用上下文的allocator只解析匹配的值，结果用deleteCjson_ctx释放
+extern void* cjson_binary_encode(const Cjson* root, size_t* len); //编码成二进制，不用转义和格式化数字，返回的内存用cjson_binary_free释放
+extern void cjson_binary_free(void* data); //释放cjson_binary_encode返回的内存
+extern Cjson* cjson_binary_decode(const void* data, size_t len); //解码二进制，出错时返回NULL
+extern void* cjson_binary_encode_ctx(CjsonContext* mem, const Cjson* root, size_t* len); //用上下文的allocator编码，返回的内存用mem->free_fn释放
+extern Cjson* cjson_binary_decode_ctx(CjsonContext* mem, const void* data, size_t len); //用上下文的allocator解码，树用deleteCjson_ctx释放
 
-extern const char* print_json(const Cjson* out); //输出json格式
+extern const char* print_json(const Cjson* out); //输出json格式，没有内存或者树不合法时返回NULL
+extern const char* print_json_ctx(CjsonContext* mem, const Cjson* out); //用上下文的allocator输出
+extern bool print_json_into(const Cjson* out, char* buf, size_t cap, size_t* written); //输出到调用者提供的缓冲区，空间不够返回false
+extern const char* print_json_opts(const Cjson* out, const CjsonPrintOptions* opts); //按选项输出，opts为NULL时和print_json一样
+extern bool cjson_print_stream(const Cjson* out, const CjsonPrintOptions* opts, cjson_write_fn write, void* userdata); //分块交给write，不在内存里拼出整个输出
+extern bool cjson_print_file(const Cjson* out, const CjsonPrintOptions* opts, FILE* fp); //分块写到文件里
+extern bool cjson_print_fd(const Cjson* out, const CjsonPrintOptions* opts, int fd); //分块写到文件描述符
+extern const char* print_json_opts_ctx(CjsonContext* mem, const Cjson* out, const CjsonPrintOptions* opts); //用上下文的allocator按选项输出
+extern bool cjson_print_stream_ctx(CjsonContext* mem, const Cjson* out, const CjsonPrintOptions* opts, cjson_write_fn write, void* userdata); //排序和深嵌套的临时空间用上下文的allocator
+extern bool cjson_print_file_ctx(CjsonContext* mem, const Cjson* out, const CjsonPrintOptions* opts, FILE* fp); //用上下文的allocator分块写到文件里
+extern bool cjson_print_fd_ctx(CjsonContext* mem, const Cjson* out, const CjsonPrintOptions* opts, int fd); //用上下文的allocator分块写到文件描述符
 
 //创建各种类型的节点
 #define create_null_node() create_simple_type_node(NodeType_NULL, "null")   //创建null节点